@@ -0,0 +1,56 @@
+/*
+	MazeGame/Maze/CookAssets.cpp
+
+	Offline asset cooker, built and run by "make -f ... cook_assets".
+
+	Imports every model of ModelList.h with Assimp and writes it as a cooked
+	mesh (see VulkanCookedMesh.hpp) in the final vertex and index layout.
+	Models whose cooked file is still up to date are skipped.
+
+*/
+
+#include <iostream>
+#include "VulkanCookedMesh.hpp"
+#include "MeshAssets.h"
+#include "ModelList.h"
+
+int main(int argc, char** argv){
+	bool force = argc > 1 && std::string(argv[1]) == "--force";
+
+	vks::VertexLayout layout = MazeGame::modelVertexLayout();
+	vks::ModelCreateInfo createInfo = MazeGame::modelCreateInfo();
+
+	int failed = 0;
+	for(int i = 0; i < MazeGame::M_LAST; i++){
+		std::string const& name = MazeGame::model_filenames[i];
+		std::string source = MazeGame::modelSourcePath(name);
+		std::string cooked = MazeGame::modelCookedPath(name);
+
+		vks::cooked::SourceStamp stamp = vks::cooked::stamp(source);
+		if(!stamp.exists){
+			std::cerr << name << ": " << source << " not found" << std::endl;
+			failed++;
+			continue;
+		}
+
+		if(!force){
+			vks::cooked::MappedFile file;
+			std::string reason;
+			if(file.open(cooked) && vks::cooked::validate(file, layout, createInfo, stamp, reason)){
+				std::cout << name << ": up to date" << std::endl;
+				continue;
+			}
+		}
+
+		vks::Model::Data data;
+		if(!vks::Model::importFromFile(source, layout, &createInfo, data) || !vks::cooked::write(cooked, data, layout, createInfo, stamp)){
+			std::cerr << name << ": cooking failed" << std::endl;
+			failed++;
+			continue;
+		}
+
+		std::cout << name << ": " << data.vertexCount << " vertices, " << data.indexCount << " indices -> " << cooked << std::endl;
+	}
+
+	return failed ? 1 : 0;
+}
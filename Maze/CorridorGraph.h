@@ -0,0 +1,534 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "GameField.h"
+
+
+
+/*
+	MazeGame/Maze/CorridorGraph.h
+
+
+	Contraction of a CellField into the graph of its junctions and the
+	corridors between them, for long searches on generated mazes.
+
+	Nodes are the path cells with other than two path neighbours
+	(junctions, dead ends, open ground), edges are the corridors of
+	two-neighbour cells between them and know their number of moves. A
+	closed ring of corridor cells gets one pinned node of its own. Every
+	cell is tagged with its node or with its edge and its moves from the
+	first end, so a change of one cell only retraces the corridors around
+	it (see cellChanged()).
+
+	Routes are searched with A* on the nodes and come out as legs, the
+	first move out of a cell and the number of moves after it. A walk
+	follows the corridor of a leg cell by cell, nothing is expanded before
+	it is walked.
+
+	Cells count as passable the way PathRule sees them, the graph is built
+	on the first query after the field changed in any other way than
+	through setType().
+
+*/
+
+
+namespace MazeGame{
+
+
+class CorridorRoute{
+public:
+	struct Leg{
+		uint8_t step;
+		uint32_t moves;
+	};
+private:
+	friend class CorridorGraph;
+
+	std::vector<Leg> legs_;
+	size_t size_ = 0;
+	int x_ = 0, y_ = 0;
+	size_t leg_ = 0;
+	uint32_t done_ = 0;
+	int last_ = 0;
+public:
+	void reset(int x, int y){
+		legs_.clear();
+		size_ = 0;
+		x_ = x;
+		y_ = y;
+		leg_ = 0;
+		done_ = 0;
+	}
+
+	// Number of moves
+	size_t size() const{
+		return size_;
+	}
+
+	bool empty() const{
+		return size_ == 0;
+	}
+
+	std::vector<Leg> const& legs() const{
+		return legs_;
+	}
+
+	// Cell the walk is in
+	int x() const{
+		return x_;
+	}
+
+	int y() const{
+		return y_;
+	}
+
+	// Step code of the next move of the walk, -1 once it has arrived. Within a leg the walk takes the
+	// only way on through its corridor, the cells of field must not have changed since the search
+	int next(CellField const& field){
+		if(leg_ >= legs_.size())
+			return -1;
+
+		Leg const& leg = legs_[leg_];
+		int step = leg.step;
+		if(done_ > 0){
+			for(step = 0; step < 4; step++){
+				if(step == reverseStep(last_))
+					continue;
+				int dir = stepDir(step);
+				if(field.getType(x_ + nei_dirs[dir].first, y_ + nei_dirs[dir].second) == CellType::PATH)
+					break;
+			}
+		}
+
+		x_ += nei_dirs[stepDir(step)].first;
+		y_ += nei_dirs[stepDir(step)].second;
+		last_ = step;
+		if(++done_ == leg.moves){
+			leg_++;
+			done_ = 0;
+		}
+		return step;
+	}
+};
+
+
+class CorridorGraph{
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	struct Node{
+		uint32_t cell = NONE;
+		uint32_t exits[4] = {NONE, NONE, NONE, NONE};	// edge leaving in every step direction
+		bool pinned = false;
+	};
+
+	// Corridor from node[0] to node[1], exit[i] is the step out of node[i] into it
+	struct Edge{
+		uint32_t node[2] = {NONE, NONE};
+		uint8_t exit[2] = {0, 0};
+		uint32_t length = 0;
+	};
+
+	CellField const& field_;
+	int width_ = 0, height_ = 0;
+	bool built_ = false;
+	uint64_t revision_ = 0;
+
+	std::vector<uint32_t> nodeOf_;
+	std::vector<uint32_t> edgeOf_;
+	std::vector<uint32_t> offsetOf_;	// moves from node[0] of the edge
+	std::vector<Node> nodes_;
+	std::vector<uint32_t> freeNodes_;
+	std::vector<Edge> edges_;
+	std::vector<uint32_t> freeEdges_;
+	size_t nodeCount_ = 0, edgeCount_ = 0;
+
+	// Storage of the updates and searches, reused between them
+	std::vector<uint32_t> seeds_, strays_;
+	std::vector<uint32_t> stamp_, cost_, parent_, moves_;
+	std::vector<uint8_t> step_;
+	uint32_t generation_ = 0;
+	IndexedHeap open_;
+	PathStats stats_;
+
+	bool passable(uint32_t cell) const{
+		return field_.cellAt(cell)->type == CellType::PATH;
+	}
+
+	bool inside(uint32_t cell, int step) const{
+		Cell const* at = field_.cellAt(cell);
+		switch(step){
+			case STEP_UP: return at->y > 0;
+			case STEP_RIGHT: return at->x < width_ - 1;
+			case STEP_DOWN: return at->y < height_ - 1;
+			default: return at->x > 0;
+		}
+	}
+
+	int offset(int step) const{
+		return step == STEP_UP ? -width_ : step == STEP_RIGHT ? 1 : step == STEP_DOWN ? width_ : -1;
+	}
+
+	bool canStep(uint32_t cell, int step) const{
+		return inside(cell, step) && passable(cell + offset(step));
+	}
+
+	int degree(uint32_t cell) const{
+		int count = 0;
+		for(int step = 0; step < 4; step++)
+			if(canStep(cell, step))
+				count++;
+		return count;
+	}
+
+	uint32_t addNode(uint32_t cell, bool pinned){
+		uint32_t id;
+		if(freeNodes_.empty()){
+			id = static_cast<uint32_t>(nodes_.size());
+			nodes_.emplace_back();
+		}
+		else{
+			id = freeNodes_.back();
+			freeNodes_.pop_back();
+			nodes_[id] = Node();
+		}
+		nodes_[id].cell = cell;
+		nodes_[id].pinned = pinned;
+		nodeOf_[cell] = id;
+		nodeCount_++;
+		return id;
+	}
+
+	// The node must not have edges left
+	void removeNode(uint32_t id){
+		nodeOf_[nodes_[id].cell] = NONE;
+		nodes_[id].cell = NONE;
+		freeNodes_.push_back(id);
+		nodeCount_--;
+	}
+
+	// Follows the corridor out of node in the direction of step up to the next node and adds its edge
+	void trace(uint32_t node, int step){
+		uint32_t id;
+		if(freeEdges_.empty()){
+			id = static_cast<uint32_t>(edges_.size());
+			edges_.emplace_back();
+		}
+		else{
+			id = freeEdges_.back();
+			freeEdges_.pop_back();
+		}
+		edgeCount_++;
+
+		uint32_t cur = nodes_[node].cell;
+		int last = step;
+		uint32_t moves = 0;
+		while(true){
+			cur += offset(last);
+			moves++;
+			if(nodeOf_[cur] != NONE)
+				break;
+			edgeOf_[cur] = id;
+			offsetOf_[cur] = moves;
+			for(int next = 0; next < 4; next++)
+				if(next != reverseStep(last) && canStep(cur, next)){
+					last = next;
+					break;
+				}
+		}
+
+		Edge& edge = edges_[id];
+		edge.node[0] = node;
+		edge.node[1] = nodeOf_[cur];
+		edge.exit[0] = static_cast<uint8_t>(step);
+		edge.exit[1] = static_cast<uint8_t>(reverseStep(last));
+		edge.length = moves;
+		nodes_[edge.node[0]].exits[edge.exit[0]] = id;
+		nodes_[edge.node[1]].exits[edge.exit[1]] = id;
+	}
+
+	void traceExits(uint32_t node){
+		for(int step = 0; step < 4; step++)
+			if(nodes_[node].cell != NONE && nodes_[node].exits[step] == NONE && canStep(nodes_[node].cell, step))
+				trace(node, step);
+	}
+
+	// Unlinks the edge from its nodes and untags its cells, which are walked by their tags as the
+	// field may already have changed under them. The nodes and cells are kept to be traced again
+	void removeEdge(uint32_t id){
+		Edge edge = edges_[id];
+		uint32_t cur = nodes_[edge.node[0]].cell + offset(edge.exit[0]);
+		for(uint32_t moves = 1; moves < edge.length; moves++){
+			edgeOf_[cur] = NONE;
+			strays_.push_back(cur);
+			for(int step = 0; step < 4; step++){
+				if(!inside(cur, step))
+					continue;
+				uint32_t next = cur + offset(step);
+				if(edgeOf_[next] == id && offsetOf_[next] == moves + 1){
+					cur = next;
+					break;
+				}
+			}
+		}
+
+		nodes_[edge.node[0]].exits[edge.exit[0]] = NONE;
+		nodes_[edge.node[1]].exits[edge.exit[1]] = NONE;
+		seeds_.push_back(edge.node[0]);
+		seeds_.push_back(edge.node[1]);
+		freeEdges_.push_back(id);
+		edgeCount_--;
+	}
+
+	// Makes the cell a node or a corridor cell after its neighbourhood changed, its edges are gone
+	void refreshNode(uint32_t cell){
+		bool open = passable(cell);
+		int neighbours = open ? degree(cell) : 0;
+		uint32_t id = nodeOf_[cell];
+		if(id != NONE){
+			if(open && (neighbours != 2 || nodes_[id].pinned)){
+				nodes_[id].pinned = neighbours == 2;
+				return;
+			}
+			removeNode(id);
+		}
+		if(open && neighbours != 2)
+			addNode(cell, false);
+	}
+
+	// Corridor cells no trace reached lie on a ring without nodes, the ring gets one
+	void pinStrays(){
+		for(uint32_t cell: strays_)
+			if(passable(cell) && nodeOf_[cell] == NONE && edgeOf_[cell] == NONE)
+				traceExits(addNode(cell, true));
+		strays_.clear();
+	}
+
+	// Step out of a corridor cell toward the given end of its edge
+	int towardEnd(uint32_t cell, int end) const{
+		Edge const& edge = edges_[edgeOf_[cell]];
+		uint32_t moves = offsetOf_[cell];
+		if(end == 0 ? moves == 1 : moves + 1 == edge.length)
+			return reverseStep(edge.exit[end]);
+		uint32_t wanted = end == 0 ? moves - 1 : moves + 1;
+		for(int step = 0; step < 4; step++){
+			if(!inside(cell, step))
+				continue;
+			uint32_t next = cell + offset(step);
+			if(edgeOf_[next] == edgeOf_[cell] && offsetOf_[next] == wanted)
+				return step;
+		}
+		return -1;
+	}
+
+	// Reaches search node id with cost moves, the last leg leaves parent by step and takes legMoves
+	void relax(uint32_t id, uint32_t cost, uint32_t parent, int step, uint32_t legMoves, uint32_t estimate){
+		bool seen = stamp_[id] == generation_;
+		if(seen && (open_.closed(id) || cost_[id] <= cost))
+			return;
+		stamp_[id] = generation_;
+		cost_[id] = cost;
+		parent_[id] = parent;
+		step_[id] = static_cast<uint8_t>(step);
+		moves_[id] = legMoves;
+
+		// Among equal estimates the one with more moves (closer to the goal) first
+		uint64_t key = (static_cast<uint64_t>(cost + estimate) << 32) | (UINT32_MAX - cost);
+		if(seen)
+			open_.decrease(id, key);
+		else{
+			open_.push(id, key);
+			stats_.pushed++;
+		}
+	}
+
+	uint32_t distance(uint32_t from, uint32_t to) const{
+		Cell const* a = field_.cellAt(from);
+		Cell const* b = field_.cellAt(to);
+		return std::abs(a->x - b->x) + std::abs(a->y - b->y);
+	}
+
+public:
+	explicit CorridorGraph(CellField const& field): field_(field){}
+
+	CorridorGraph(CorridorGraph const&) = delete;
+
+	// Contracts the whole field
+	void build(){
+		width_ = field_.getWidth();
+		height_ = field_.getHeight();
+		size_t cells = static_cast<size_t>(width_) * height_;
+		nodeOf_.assign(cells, NONE);
+		edgeOf_.assign(cells, NONE);
+		offsetOf_.assign(cells, 0);
+		nodes_.clear();
+		freeNodes_.clear();
+		edges_.clear();
+		freeEdges_.clear();
+		nodeCount_ = edgeCount_ = 0;
+
+		for(uint32_t cell = 0; cell < cells; cell++)
+			if(passable(cell) && degree(cell) != 2)
+				addNode(cell, false);
+		for(uint32_t node = 0; node < nodes_.size(); node++)
+			traceExits(node);
+
+		strays_.clear();
+		for(uint32_t cell = 0; cell < cells; cell++)
+			if(passable(cell) && nodeOf_[cell] == NONE && edgeOf_[cell] == NONE)
+				strays_.push_back(cell);
+		pinStrays();
+
+		built_ = true;
+		revision_ = field_.revision();
+	}
+
+	// Follows the change of the type of one cell. Only the corridors through the cell and its
+	// neighbours are traced again, a graph missing earlier changes is left to the next build()
+	void cellChanged(int x, int y){
+		if(!built_ || revision_ + 1 != field_.revision() || width_ != field_.getWidth() || height_ != field_.getHeight())
+			return;
+		revision_ = field_.revision();
+
+		uint32_t cell = y * width_ + x;
+		uint32_t affected[5];
+		int count = 0;
+		affected[count++] = cell;
+		for(int step = 0; step < 4; step++)
+			if(inside(cell, step))
+				affected[count++] = cell + offset(step);
+
+		seeds_.clear();
+		strays_.clear();
+		for(int i = 0; i < count; i++){
+			uint32_t at = affected[i];
+			if(edgeOf_[at] != NONE)
+				removeEdge(edgeOf_[at]);
+			if(nodeOf_[at] != NONE)
+				for(int step = 0; step < 4; step++)
+					if(nodes_[nodeOf_[at]].exits[step] != NONE)
+						removeEdge(nodes_[nodeOf_[at]].exits[step]);
+		}
+
+		for(int i = 0; i < count; i++){
+			refreshNode(affected[i]);
+			strays_.push_back(affected[i]);
+			if(nodeOf_[affected[i]] != NONE)
+				seeds_.push_back(nodeOf_[affected[i]]);
+		}
+
+		for(uint32_t node: seeds_)
+			traceExits(node);
+		pinStrays();
+	}
+
+	// Shortest route from (x1, y1) to (x2, y2), false if there is none
+	bool findRoute(int x1, int y1, int x2, int y2, CorridorRoute& route){
+		route.reset(x1, y1);
+		stats_ = PathStats();
+		if(x1 < 0 || x1 >= field_.getWidth() || y1 < 0 || y1 >= field_.getHeight() || x2 < 0 || x2 >= field_.getWidth() || y2 < 0 || y2 >= field_.getHeight())
+			return false;
+		if(!built_ || revision_ != field_.revision())
+			build();
+
+		uint32_t start = y1 * width_ + x1;
+		uint32_t goal = y2 * width_ + x2;
+		if(start == goal)
+			return true;
+		if(!passable(start) || !passable(goal))
+			return false;
+
+		// One more search node stands for a goal inside a corridor
+		uint32_t target = nodeOf_[goal] != NONE ? nodeOf_[goal] : static_cast<uint32_t>(nodes_.size());
+		size_t searchNodes = nodes_.size() + 1;
+		if(stamp_.size() < searchNodes){
+			stamp_.resize(searchNodes, 0);
+			cost_.resize(searchNodes);
+			parent_.resize(searchNodes);
+			moves_.resize(searchNodes);
+			step_.resize(searchNodes);
+		}
+		open_.resize(searchNodes);
+		open_.clear();
+		if(++generation_ == 0){
+			std::fill(stamp_.begin(), stamp_.end(), 0);
+			generation_ = 1;
+		}
+
+		auto estimate = [&](uint32_t id){
+			return id == target ? 0 : distance(nodes_[id].cell, goal);
+		};
+
+		if(nodeOf_[start] != NONE)
+			relax(nodeOf_[start], 0, NONE, 0, 0, estimate(nodeOf_[start]));
+		else{
+			Edge const& edge = edges_[edgeOf_[start]];
+			uint32_t moves = offsetOf_[start];
+			relax(edge.node[0], moves, NONE, towardEnd(start, 0), moves, estimate(edge.node[0]));
+			relax(edge.node[1], edge.length - moves, NONE, towardEnd(start, 1), edge.length - moves, estimate(edge.node[1]));
+			// Straight along the corridor both are in
+			if(edgeOf_[goal] == edgeOf_[start]){
+				uint32_t goalMoves = offsetOf_[goal];
+				int end = goalMoves < moves ? 0 : 1;
+				uint32_t between = end == 0 ? moves - goalMoves : goalMoves - moves;
+				relax(target, between, NONE, towardEnd(start, end), between, 0);
+			}
+		}
+
+		while(!open_.empty()){
+			uint32_t id = open_.pop();
+			if(id == target)
+				break;
+			stats_.expanded++;
+
+			Node const& node = nodes_[id];
+			for(int step = 0; step < 4; step++){
+				if(node.exits[step] == NONE)
+					continue;
+				Edge const& edge = edges_[node.exits[step]];
+				int end = edge.node[0] == id && edge.exit[0] == step ? 0 : 1;
+				uint32_t next = edge.node[1 - end];
+				relax(next, cost_[id] + edge.length, id, step, edge.length, estimate(next));
+			}
+
+			// Into the corridor of the goal
+			if(nodeOf_[goal] == NONE){
+				Edge const& edge = edges_[edgeOf_[goal]];
+				uint32_t goalMoves = offsetOf_[goal];
+				for(int end = 0; end < 2; end++)
+					if(edge.node[end] == id){
+						uint32_t moves = end == 0 ? goalMoves : edge.length - goalMoves;
+						relax(target, cost_[id] + moves, id, edge.exit[end], moves, 0);
+					}
+			}
+		}
+
+		if(stamp_[target] != generation_ || !open_.closed(target))
+			return false;
+
+		for(uint32_t id = target; id != NONE; id = parent_[id])
+			if(moves_[id] > 0)
+				route.legs_.push_back({step_[id], moves_[id]});
+		std::reverse(route.legs_.begin(), route.legs_.end());
+		route.size_ = cost_[target];
+		return true;
+	}
+
+	// Number of nodes and edges of the graph
+	size_t nodeCount() const{
+		return nodeCount_;
+	}
+
+	size_t edgeCount() const{
+		return edgeCount_;
+	}
+
+	// Work of the last findRoute()
+	PathStats const& lastStats() const{
+		return stats_;
+	}
+};
+
+
+};
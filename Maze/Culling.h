@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "frustum.hpp"
+#include "InstanceData.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MAZE_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+/*
+	MazeGame/Maze/Culling.h
+
+	View frustum culling of instances on the CPU.
+
+	Instances are tested as bounding spheres against the planes of vks::Frustum,
+	four at a time when SSE is available. The sphere of a travelling instance
+	encloses the whole way from pos to to. Visible instances are copied into a
+	compacted array which is drawn instead of the whole instance buffer.
+
+*/
+
+class FrustumCuller{
+
+	vks::Frustum frustum;
+
+	// Planes split into components, so that one component can be broadcasted to a whole batch
+	float px[6], py[6], pz[6], pw[6];
+
+public:
+
+	void update(glm::mat4 const& viewProjection){
+		frustum.update(viewProjection);
+		for(int i = 0; i < 6; i++){
+			px[i] = frustum.planes[i].x;
+			py[i] = frustum.planes[i].y;
+			pz[i] = frustum.planes[i].z;
+			pw[i] = frustum.planes[i].w;
+		}
+	}
+
+	std::array<glm::vec4, 6> const& planes() const{
+		return frustum.planes;
+	}
+
+	bool checkSphere(glm::vec3 pos, float radius) const{
+		for(int i = 0; i < 6; i++)
+			if(px[i] * pos.x + py[i] * pos.y + pz[i] * pos.z + pw[i] <= -radius)
+				return false;
+		return true;
+	}
+
+	// Copies the visible instances into out and returns their number,
+	// radius is the bounding sphere radius of an instance with scale 1
+	size_t cull(InstanceData const* instances, size_t count, float radius, InstanceData* out) const{
+		size_t visible = 0;
+		size_t i = 0;
+
+#if defined(MAZE_CULLING_SSE)
+		__m128 r = _mm_set1_ps(radius);
+		__m128 zero = _mm_setzero_ps();
+		__m128 half = _mm_set1_ps(0.5f);
+		for(; i + 4 <= count; i += 4){
+			InstanceData const* batch = instances + i;
+			__m128 x = _mm_set_ps(batch[3].pos.x, batch[2].pos.x, batch[1].pos.x, batch[0].pos.x);
+			__m128 y = _mm_set_ps(batch[3].pos.y, batch[2].pos.y, batch[1].pos.y, batch[0].pos.y);
+			__m128 z = _mm_set_ps(batch[3].pos.z, batch[2].pos.z, batch[1].pos.z, batch[0].pos.z);
+			__m128 tx = _mm_set_ps(batch[3].to.x, batch[2].to.x, batch[1].to.x, batch[0].to.x);
+			__m128 ty = _mm_set_ps(batch[3].to.y, batch[2].to.y, batch[1].to.y, batch[0].to.y);
+			__m128 tz = _mm_set_ps(batch[3].to.z, batch[2].to.z, batch[1].to.z, batch[0].to.z);
+			__m128 scale = _mm_set_ps(batch[3].scale, batch[2].scale, batch[1].scale, batch[0].scale);
+
+			// Center of the way and half of its length
+			__m128 dx = _mm_mul_ps(half, _mm_sub_ps(tx, x));
+			__m128 dy = _mm_mul_ps(half, _mm_sub_ps(ty, y));
+			__m128 dz = _mm_mul_ps(half, _mm_sub_ps(tz, z));
+			x = _mm_add_ps(x, dx);
+			y = _mm_add_ps(y, dy);
+			z = _mm_add_ps(z, dz);
+			__m128 way = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 negRadius = _mm_sub_ps(zero, _mm_add_ps(_mm_mul_ps(r, scale), way));
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for(int p = 0; p < 6; p++){
+				__m128 d = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(px[p]), x), _mm_mul_ps(_mm_set1_ps(py[p]), y)),
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pz[p]), z), _mm_set1_ps(pw[p])));
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for(int k = 0; k < 4; k++)
+				if(mask & (1 << k))
+					out[visible++] = batch[k];
+		}
+#endif
+
+		for(; i < count; i++){
+			glm::vec3 halfWay = 0.5f * (instances[i].to - instances[i].pos);
+			if(checkSphere(instances[i].pos + halfWay, radius * instances[i].scale + glm::length(halfWay)))
+				out[visible++] = instances[i];
+		}
+
+		return visible;
+	}
+};
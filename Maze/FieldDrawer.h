@@ -1,5 +1,175 @@
 #pragma once
+#include "VulkanExample.h"
 #include "GameField.h"
-#include "DrawableTriangle.h"
 
+/*
+	MazeGame/Maze/FieldDrawer.h
 
+	Turns the cells of a field into static meshes.
+
+	The field is split into square chunks, each chunk is meshed on its own
+	so that changing a cell rebuilds only the chunks around it. Only the
+	visible faces are emitted: tops of walls and paths and the wall sides
+	facing a path (or the outside of the field). Coplanar faces are merged
+	greedily into as few quads as possible.
+
+*/
+
+namespace triGraphic{
+
+
+class FieldMesher{
+
+	float cellSize;
+	float zeroLevel;
+
+	// Color the cube models get from their materials
+	glm::vec3 color = {0.6f, 0.6f, 0.6f};
+
+	// Adds quad corner, corner + u, corner + u + v, corner + v facing along the normal,
+	// uvSize is the number of texture repeats along u and v
+	void addQuad(MeshData& mesh, glm::vec3 corner, glm::vec3 u, glm::vec3 v, glm::vec3 normal, glm::vec2 uvSize) const{
+		uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+
+		glm::vec3 positions[4] = {corner, corner + u, corner + u + v, corner + v};
+		glm::vec2 uvs[4] = {{0.0f, 0.0f}, {uvSize.x, 0.0f}, uvSize, {0.0f, uvSize.y}};
+		for(int i = 0; i < 4; i++){
+			Vertex vertex;
+			vertex.position = positions[i];
+			vertex.normal = normal;
+			vertex.uv = uvs[i];
+			vertex.color = color;
+			mesh.vertices.push_back(vertex);
+		}
+
+		// Front faces have the winding of the loaded models: (b - a) x (c - a) points along the normal
+		if(glm::dot(glm::cross(u, v), normal) > 0.0f)
+			mesh.indices.insert(mesh.indices.end(), {first, first + 1, first + 2, first, first + 2, first + 3});
+		else
+			mesh.indices.insert(mesh.indices.end(), {first, first + 2, first + 1, first, first + 3, first + 2});
+	}
+
+	// Merges the cells of the given type into rectangles lying at the given height
+	void meshTops(MazeGame::CellField const& field, int x0, int y0, int x1, int y1, MazeGame::CellType type, float height, MeshData& mesh) const{
+		int w = x1 - x0, h = y1 - y0;
+		std::vector<bool> used(w * h, false);
+		auto fits = [&](int x, int y){
+			return !used[(y - y0) * w + (x - x0)] && field.getType(x, y) == type;
+		};
+
+		for(int y = y0; y < y1; y++)
+			for(int x = x0; x < x1; x++){
+				if(!fits(x, y))
+					continue;
+
+				int qw = 1;
+				while(x + qw < x1 && fits(x + qw, y))
+					qw++;
+
+				int qh = 1;
+				for(bool grow = true; grow && y + qh < y1; ){
+					for(int i = 0; i < qw; i++)
+						if(!fits(x + i, y + qh)){
+							grow = false;
+							break;
+						}
+					if(grow)
+						qh++;
+				}
+
+				for(int j = 0; j < qh; j++)
+					for(int i = 0; i < qw; i++)
+						used[(y + j - y0) * w + (x + i - x0)] = true;
+
+				addQuad(mesh, {(x - 0.5f) * cellSize, height, (y - 0.5f) * cellSize}, {qw * cellSize, 0.0f, 0.0f}, {0.0f, 0.0f, qh * cellSize}, {0.0f, -1.0f, 0.0f}, {qw, qh});
+			}
+	}
+
+	// Merges the exposed wall sides into runs along rows (up, down) and columns (right, left)
+	void meshSides(MazeGame::CellField const& field, int x0, int y0, int x1, int y1, MeshData& mesh) const{
+		int w = x1 - x0, h = y1 - y0;
+
+		// Bit i is set if the side i (up right down left) of the cell is visible
+		std::vector<uint8_t> open(w * h, 0);
+		for(int y = y0; y < y1; y++)
+			for(int x = x0; x < x1; x++){
+				if(field.getType(x, y) != MazeGame::CellType::WALL)
+					continue;
+				std::vector<bool> sides = field.openSideFaces(x, y);
+				uint8_t mask = 0;
+				for(int i = 0; i < 4; i++){
+					int nx = x + MazeGame::nei_dirs[i * 2].first;
+					int ny = y + MazeGame::nei_dirs[i * 2].second;
+					bool outside = nx < 0 || ny < 0 || nx >= field.getWidth() || ny >= field.getHeight();
+					if(sides[i] || outside)
+						mask |= 1 << i;
+				}
+				open[(y - y0) * w + (x - x0)] = mask;
+			}
+
+		auto isOpen = [&](int x, int y, int side){
+			return (open[(y - y0) * w + (x - x0)] >> side) & 1;
+		};
+
+		float top = zeroLevel - cellSize;
+		glm::vec3 up = {0.0f, cellSize, 0.0f};
+
+		for(int side = 0; side < 4; side++){
+			glm::vec3 normal = {static_cast<float>(MazeGame::nei_dirs[side * 2].first), 0.0f, static_cast<float>(MazeGame::nei_dirs[side * 2].second)};
+			bool alongRow = (side % 2 == 0);
+			int lines = alongRow ? h : w;
+			int length = alongRow ? w : h;
+
+			for(int line = 0; line < lines; line++)
+				for(int i = 0; i < length; ){
+					auto cellOpen = [&](int k){
+						return alongRow ? isOpen(x0 + k, y0 + line, side) : isOpen(x0 + line, y0 + k, side);
+					};
+					if(!cellOpen(i)){
+						i++;
+						continue;
+					}
+					int run = 1;
+					while(i + run < length && cellOpen(i + run))
+						run++;
+
+					int x = alongRow ? x0 + i : x0 + line;
+					int y = alongRow ? y0 + line : y0 + i;
+					// Face plane lies half a cell from the center towards the neighbour
+					glm::vec3 corner = {(x - 0.5f) * cellSize, top, (y - 0.5f) * cellSize};
+					if(normal.x > 0.0f)
+						corner.x += cellSize;
+					if(normal.z > 0.0f)
+						corner.z += cellSize;
+					glm::vec3 along = alongRow ? glm::vec3{run * cellSize, 0.0f, 0.0f} : glm::vec3{0.0f, 0.0f, run * cellSize};
+
+					addQuad(mesh, corner, along, up, normal, {run, 1.0f});
+					i += run;
+				}
+		}
+	}
+
+public:
+	static constexpr int CHUNK_SIZE = 32;
+
+	FieldMesher(float cs = 10.0f, float zl = 10.0f): cellSize(cs), zeroLevel(zl){};
+
+	// Builds wall and path geometry of the chunk (cx, cy)
+	void buildChunk(MazeGame::CellField const& field, int cx, int cy, MeshData& walls, MeshData& paths) const{
+		walls = MeshData{};
+		paths = MeshData{};
+
+		int x0 = cx * CHUNK_SIZE, y0 = cy * CHUNK_SIZE;
+		int x1 = std::min(x0 + CHUNK_SIZE, field.getWidth());
+		int y1 = std::min(y0 + CHUNK_SIZE, field.getHeight());
+		if(x0 >= x1 || y0 >= y1)
+			return;
+
+		meshTops(field, x0, y0, x1, y1, MazeGame::CellType::WALL, zeroLevel - cellSize, walls);
+		meshSides(field, x0, y0, x1, y1, walls);
+		meshTops(field, x0, y0, x1, y1, MazeGame::CellType::PATH, zeroLevel, paths);
+	}
+};
+
+
+};
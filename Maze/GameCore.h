@@ -3,6 +3,8 @@
 
 #include "Models.h"
 #include "InputHandler.h"
+#include "CorridorGraph.h"
+#include "SectorGraph.h"
 
 
 namespace MazeGame{
@@ -59,6 +61,15 @@ public:
 class GameCore: public ::triGraphic::Field{
 
 	std::list<GameObject*> objects;
+
+	struct SharedFlow{
+		FlowField field;
+		bool used = false;
+	};
+	std::unordered_map<GameObject const*, SharedFlow> flows;
+
+	CorridorGraph corridors{*this};
+	SectorGraph sectors{*this};
 protected:
 
 	bool quit = false;
@@ -72,16 +83,20 @@ public:
 			::triGraphic::Field::operator=(static_cast<::triGraphic::Field&&>(another));
 			objects = another.objects;
 			another.objects.clear();
+			flows.clear();
 		}
 		return *this;
 	}
 
 	virtual void update(float dt) {
+		// Moves started during this update begin at the time of the frame
+		triGraphic::transforms.advance(dt);
+		drawer->setSceneTime(triGraphic::transforms.time());
+
 		for(auto& object: objects)
 			if(object != nullptr)
 				object->update(dt);
 
-
 		for(auto& object: objects)
 			for(auto& nei: object->getParent()->objects)
 				if(nei != object) 
@@ -94,6 +109,18 @@ public:
 			}
 			
 		objects.remove_if([](GameObject* const& obj) -> bool { return obj == nullptr; });
+
+		// Flow fields nobody followed during this update are dropped, their aim may be gone
+		for(auto it = flows.begin(); it != flows.end(); ){
+			if(!it->second.used){
+				it = flows.erase(it);
+				continue;
+			}
+			it->second.used = false;
+			it++;
+		}
+
+		refresh();
 	}
 
 	virtual void initialize() = 0;
@@ -114,6 +141,33 @@ public:
 		objects.resize(0);	
 	}
 
+	// Directions toward the cell of aim, shared by everything chasing it. The search runs again
+	// only once aim entered another cell or the field changed
+	FlowField const& flowToward(GameObject* aim){
+		SharedFlow& flow = flows[aim];
+		flow.used = true;
+		Cell const* target = aim->getParent();
+		if(!flow.field.leadsTo(target->x, target->y, revision()))
+			buildFlowField(target->x, target->y, flow.field);
+		return flow.field;
+	}
+
+	// Junctions and corridors of the field for long searches, built with the first route asked for
+	CorridorGraph& corridorGraph(){
+		return corridors;
+	}
+
+	// Sectors of the field for long searches across open space, built with the first route asked for
+	SectorGraph& sectorGraph(){
+		return sectors;
+	}
+
+	void onCellChanged(int x, int y) override{
+		::triGraphic::Field::onCellChanged(x, y);
+		corridors.cellChanged(x, y);
+		sectors.cellChanged(x, y);
+	}
+
 	InputHandler& getInputHandler(){
 		return inputHandler;
 	}
@@ -3,7 +3,9 @@
 #include <list>
 #include <cstdlib>
 #include <unordered_map>
+#include <functional>
 #include <iostream>
+#include "PathFinding.h"
 
 
 
@@ -63,6 +65,13 @@ struct Cell {
 };
 
 
+// Default rule of the path searches, both cells have to be paths
+struct PathRule{
+	bool operator()(const Cell* from, const Cell* into) const{
+		return from->type == CellType::PATH && into->type == CellType::PATH;
+	}
+};
+
 
 extern bool should_update_static_vertices;
 
@@ -70,6 +79,7 @@ class CellField{
 	
 	std::vector<Cell> cells;
 	int width, height;
+	uint64_t revision_ = 0;
 	bool isOutOfbounds(int x, int y) const{
 		return x < 0 || x >= width || y < 0 || y >= height;
 	};
@@ -124,7 +134,209 @@ class CellField{
 		return ret;
 	}
 
-	Cell* getRandomNewNodeCell();
+	Cell* getRandomNewNodeCell(std::vector<Cell*>& growing);
+
+	bool stepInside(uint32_t index, int step) const{
+		Cell const& cell = cells[index];
+		switch(step){
+			case STEP_UP: return cell.y > 0;
+			case STEP_RIGHT: return cell.x < width - 1;
+			case STEP_DOWN: return cell.y < height - 1;
+			default: return cell.x > 0;
+		}
+	}
+
+	int stepOffset(int step) const{
+		return step == STEP_UP ? -width : step == STEP_RIGHT ? 1 : step == STEP_DOWN ? width : -1;
+	}
+
+	template<typename Rule>
+	bool canStep(uint32_t index, int step, Rule& rule) const{
+		return stepInside(index, step) && rule(&cells[index], &cells[index + stepOffset(step)]);
+	}
+
+	// Queues cell at the given number of moves unless it already is at as few or has been expanded
+	bool relax(uint32_t index, int step, uint32_t moves, uint64_t key, PathScratch& scratch) const{
+		bool seen = scratch.visited(index);
+		if(seen && (scratch.open.closed(index) || scratch.cost[index] <= moves))
+			return false;
+		scratch.visit(index, step, moves);
+		if(seen)
+			scratch.open.decrease(index, key);
+		else{
+			scratch.open.push(index, key);
+			scratch.stats.pushed++;
+		}
+		return true;
+	}
+
+	// Key of the A* and JPS heap: moves plus the Manhattan distance left,
+	// among equal estimates the cell with more moves (closer to the goal) first
+	uint64_t estimateKey(uint32_t index, uint32_t moves, uint32_t goal) const{
+		uint32_t estimate = moves + std::abs(cells[index].x - cells[goal].x) + std::abs(cells[index].y - cells[goal].y);
+		return (static_cast<uint64_t>(estimate) << 32) | (UINT32_MAX - moves);
+	}
+
+	template<typename Rule>
+	bool searchBFS(uint32_t start, uint32_t goal, Rule& rule, PathScratch& scratch) const{
+		scratch.visit(start, 0, 0);
+		if(start == goal)
+			return true;
+		scratch.queue.push(start);
+		scratch.stats.pushed++;
+
+		while(!scratch.queue.empty()){
+			uint32_t cur = scratch.queue.pop();
+			uint32_t moves = scratch.cost[cur] + 1;
+			scratch.stats.expanded++;
+
+			for(int step = 0; step < 4; step++){
+				if(!stepInside(cur, step))
+					continue;
+				uint32_t nei = cur + stepOffset(step);
+				if(scratch.visited(nei) || !rule(&cells[cur], &cells[nei]))
+					continue;
+				scratch.visit(nei, step, moves);
+				if(nei == goal)
+					return true;
+				scratch.queue.push(nei);
+				scratch.stats.pushed++;
+			}
+		}
+		return false;
+	}
+
+	template<typename Rule>
+	bool searchAStar(uint32_t start, uint32_t goal, Rule& rule, PathScratch& scratch) const{
+		scratch.visit(start, 0, 0);
+		scratch.open.push(start, estimateKey(start, 0, goal));
+		scratch.stats.pushed++;
+
+		while(!scratch.open.empty()){
+			uint32_t cur = scratch.open.pop();
+			if(cur == goal)
+				return true;
+			uint32_t moves = scratch.cost[cur] + 1;
+			scratch.stats.expanded++;
+
+			for(int step = 0; step < 4; step++){
+				if(!stepInside(cur, step))
+					continue;
+				uint32_t nei = cur + stepOffset(step);
+				bool seen = scratch.visited(nei);
+				if(seen && (scratch.open.closed(nei) || scratch.cost[nei] <= moves))
+					continue;
+				if(rule(&cells[cur], &cells[nei]))
+					relax(nei, step, moves, estimateKey(nei, moves, goal), scratch);
+			}
+		}
+		return false;
+	}
+
+	/*
+		Jump point search on the 4-connected grid. Among the shortest paths it
+		only follows those that run vertically and turn into horizontal runs,
+		a horizontal run turns vertical only where the way opens next to a cell
+		that was walled beside the one before (a forced neighbour).
+
+		Vertical jumps stop where a horizontal jump to either side finds a jump
+		point, horizontal jumps stop at forced neighbours. The pruning assumes
+		rule only describes which cells are passable, the same in both ways.
+	*/
+
+	template<typename Rule>
+	bool jumpHorizontal(uint32_t from, int step, uint32_t goal, Rule& rule, PathScratch& scratch, uint32_t& jumpPoint, uint32_t& moves) const{
+		uint32_t cur = from;
+		moves = 0;
+		while(canStep(cur, step, rule)){
+			uint32_t prev = cur;
+			cur += stepOffset(step);
+			moves++;
+			scratch.stats.scanned++;
+
+			if(cur == goal || (canStep(cur, STEP_UP, rule) && !canStep(prev, STEP_UP, rule)) || (canStep(cur, STEP_DOWN, rule) && !canStep(prev, STEP_DOWN, rule))){
+				jumpPoint = cur;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<typename Rule>
+	bool jumpVertical(uint32_t from, int step, uint32_t goal, Rule& rule, PathScratch& scratch, uint32_t& jumpPoint, uint32_t& moves) const{
+		uint32_t cur = from;
+		moves = 0;
+		while(canStep(cur, step, rule)){
+			cur += stepOffset(step);
+			moves++;
+			scratch.stats.scanned++;
+
+			uint32_t sidePoint, sideMoves;
+			if(cur == goal || jumpHorizontal(cur, STEP_RIGHT, goal, rule, scratch, sidePoint, sideMoves) || jumpHorizontal(cur, STEP_LEFT, goal, rule, scratch, sidePoint, sideMoves)){
+				jumpPoint = cur;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Directions worth a jump out of cur, given the direction it was entered in
+	template<typename Rule>
+	bool jumpDirection(uint32_t cur, int step, uint32_t start, Rule& rule, PathScratch& scratch) const{
+		if(cur == start)
+			return true;
+		int entered = scratch.from[cur];
+		if(step == reverseStep(entered))
+			return false;
+		if(entered % 2 == STEP_UP || step == entered)
+			return true;
+		return !canStep(cur - stepOffset(entered), step, rule);
+	}
+
+	template<typename Rule>
+	bool searchJPS(uint32_t start, uint32_t goal, Rule& rule, PathScratch& scratch) const{
+		scratch.visit(start, 0, 0);
+		scratch.open.push(start, estimateKey(start, 0, goal));
+		scratch.stats.pushed++;
+
+		while(!scratch.open.empty()){
+			uint32_t cur = scratch.open.pop();
+			if(cur == goal)
+				return true;
+			scratch.stats.expanded++;
+
+			for(int step = 0; step < 4; step++){
+				if(!jumpDirection(cur, step, start, rule, scratch))
+					continue;
+				uint32_t jumpPoint, moves;
+				bool found = step % 2 == STEP_UP ? jumpVertical(cur, step, goal, rule, scratch, jumpPoint, moves) : jumpHorizontal(cur, step, goal, rule, scratch, jumpPoint, moves);
+				if(found){
+					moves += scratch.cost[cur];
+					relax(jumpPoint, step, moves, estimateKey(jumpPoint, moves, goal), scratch);
+				}
+			}
+		}
+		return false;
+	}
+
+	// Walks back from goal to start. Each cell goes back in the direction it was entered until
+	// it meets a cell with fitting moves, one move for BFS and A*, a whole jump for JPS
+	void tracePath(uint32_t start, uint32_t goal, PathScratch& scratch, CellPath& path) const{
+		for(uint32_t cur = goal; cur != start; ){
+			int step = scratch.from[cur];
+			uint32_t prev = cur;
+			uint32_t moves = 0;
+			do{
+				prev -= stepOffset(step);
+				moves++;
+				scratch.steps.push_back(step);
+			}while(!scratch.visited(prev) || scratch.cost[prev] + moves != scratch.cost[cur]);
+			cur = prev;
+		}
+		path.reserve(scratch.steps.size());
+		for(auto it = scratch.steps.rbegin(); it != scratch.steps.rend(); it++)
+			path.push(*it);
+	}
 
 public:
 	explicit CellField(int w = 0, int h = 0): width(w), height(h){
@@ -143,6 +355,7 @@ public:
 			another.cells.clear();
 			width = another.width;
 			height = another.height;
+			revision_++;
 		}
 		return *this;
 	}
@@ -156,6 +369,11 @@ public:
 		return &cells[y * width + x];
 	}
 
+	// Cell by its dense index y * width + x
+	Cell const* cellAt(uint32_t index) const{
+		return &cells[index];
+	}
+
 
 	void setType(int x, int y, CellType type){
 		if(isOutOfbounds(x, y) || (x == 0 || x == width - 1) || (y == 0 || y == height - 1))
@@ -163,15 +381,31 @@ public:
 
 		int index = y * width + x;
 
+		if(cells[index].type == type)
+			return;
+
 		cells[index].type = type;
+		revision_++;
 
+		// Static maze geometry is rebuilt only when the field actually changed
 		MazeGame::should_update_static_vertices = true;
+		onCellChanged(x, y);
+
+	};
 
+	// Called by setType() after the type of the cell has changed
+	virtual void onCellChanged(int x, int y){
 	};
 
 	void clear(CellType type = CellType::WALL){
 		for(auto& cell: cells)
 			cell.type = type;
+		revision_++;
+	}
+
+	// Grows with every change of the cells, results computed at an older revision are outdated
+	uint64_t revision() const{
+		return revision_;
 	}
 
 	Cell* getNeiCell(Cell* cell, enum Dirs dir) {
@@ -203,6 +437,7 @@ public:
 
 	void changeSize(int nWidth, int nHeight){
 		cells.clear();
+		revision_++;
 		width = nWidth;
 		height = nHeight;
 		cells.resize(width * height);
@@ -303,6 +538,7 @@ public:
 		Cell* cell = getRandomCell();
 
 		cell->type = CellType::PATH;
+		std::vector<Cell*> growing = {cell};
 		int prevDir = -1;
 		while(true){
 			std::vector<bool> probDirs = getProbDirections(cell);
@@ -318,7 +554,7 @@ public:
 			}
 
 			if(count == 0) {
-				cell = getRandomNewNodeCell();
+				cell = getRandomNewNodeCell(growing);
 				if(cell == nullptr)
 					break;
 				prevDir = -1;
@@ -335,6 +571,7 @@ public:
 				if(next_dir <= 0){
 					cell = getNeiCell(cell, static_cast<enum Dirs>(i * 2));
 					cell->type = CellType::PATH;
+					growing.push_back(cell);
 					prevDir = i;
 					break;
 				}
@@ -355,64 +592,67 @@ public:
 
 	};
 
-	std::list<Cell> findPath(int x1, int y1, int x2, int y2,
-	 std::function<bool(const Cell*, const Cell*)> rule = 
-	 [](const Cell* cell1, const Cell* cell2) -> bool { return cell1->type == CellType::PATH && cell2->type == CellType::PATH; } ) const{
-		std::list<Cell> path;
+	// Shortest way from (x1, y1) to (x2, y2) through the direct neighbours rule allows, found by
+	// the given search. Returns false if there is none, lastPathStats() tells the work it took
+	template<typename Rule = PathRule>
+	bool findPath(int x1, int y1, int x2, int y2, CellPath& path, PathSearch search = PathSearch::BFS, Rule rule = Rule()) const{
+		path.reset(x1, y1);
 		if(isOutOfbounds(x1, y1) || isOutOfbounds(x2, y2))
-			return path;
-		const Cell* cur = &cells[y1 * width + x1];
-		const Cell* goal = &cells[y2 * width + x2];		
-
-		std::list<const Cell*> frontier;
-		std::unordered_map<const Cell*, bool> visited;
-		std::unordered_map<const Cell*, const Cell*> came_from;
-		
-		frontier.emplace_back(cur);
-		
-		came_from[cur] = nullptr;
-		visited[cur] = true;
-
-		bool flag = false;
+			return false;
 
-		while(!frontier.empty()){
-			cur = frontier.front();
-			frontier.pop_front();
+		uint32_t start = y1 * width + x1;
+		uint32_t goal = y2 * width + x2;
 
-			if(cur == goal){
-				flag = true;
-				break;
-			}
+		PathScratch& scratch = PathScratch::local();
+		scratch.begin(cells.size());
 
-			for(int i = 0; i < 8; i += 2){
-				const Cell* nei = getNeiCell(cur, static_cast<enum Dirs>(i));
-				if(nei && (visited.find(nei) == visited.end()) && rule(cur, nei)){
-					visited[nei] = true;
-					came_from[nei] = cur;
-					frontier.emplace_back(nei);
-				}
-			}
+		bool found = false;
+		switch(search){
+			case PathSearch::BFS: found = searchBFS(start, goal, rule, scratch); break;
+			case PathSearch::ASTAR: found = searchAStar(start, goal, rule, scratch); break;
+			case PathSearch::JPS: found = searchJPS(start, goal, rule, scratch); break;
 		}
+		if(!found)
+			return false;
 
-		if(flag){
-			path.emplace_front(*goal);
-			cur = goal;
+		tracePath(start, goal, scratch, path);
+		return true;
+	}
 
-			while(true){
-				const Cell* prev = came_from[cur];
-				if(prev == nullptr){
-					break;
-				}
-				cur = prev;
-				path.emplace_front(*cur);
+	// Breadth-first search out of (x, y) that leaves every cell the direction of its next move toward
+	// it in flow. rule is asked about the moves toward the target, from the farther cell into the nearer
+	template<typename Rule = PathRule>
+	void buildFlowField(int x, int y, FlowField& flow, Rule rule = Rule()) const{
+		flow.reset(width, height, x, y, revision_);
+		if(isOutOfbounds(x, y))
+			return;
+
+		uint32_t target = y * width + x;
+		RingQueue& queue = PathScratch::local().queue;
+		queue.clear();
+		flow.set(target, FlowField::TARGET);
+		queue.push(target);
+
+		while(!queue.empty()){
+			uint32_t cur = queue.pop();
+			for(int step = 0; step < 4; step++){
+				if(!stepInside(cur, step))
+					continue;
+				uint32_t nei = cur + stepOffset(step);
+				if(flow.reached(nei) || !rule(&cells[nei], &cells[cur]))
+					continue;
+				flow.set(nei, static_cast<uint8_t>(reverseStep(step)));
+				queue.push(nei);
 			}
 		}
+	}
 
-
-		return path;
+	// Work of the last findPath() of the calling thread
+	static PathStats const& lastPathStats(){
+		return PathScratch::local().stats;
 	}
 
-	CellType getType(int x, int y){
+	CellType getType(int x, int y) const{
 		if(isOutOfbounds(x, y))
 			return CellType::ERR;
 
@@ -455,33 +695,20 @@ public:
 
 
 
-Cell* CellField::getRandomNewNodeCell(){
-	Cell* cur = getRandomCell([](Cell* c){ return c->type == CellType::PATH;});
-	std::list<Cell*> frontier;
-	std::unordered_map<Cell*, bool> visited;
-
-	frontier.push_back(cur);
-	visited[cur] = true;
-
-	while(!frontier.empty()){
-		cur = frontier.front();
-		frontier.pop_front();
+// Picks a random cell the maze can still grow from. Cells that can't are dropped from growing
+// for good, paths only ever close the directions around them
+Cell* CellField::getRandomNewNodeCell(std::vector<Cell*>& growing){
+	while(!growing.empty()){
+		size_t index = rand() % growing.size();
+		Cell* cur = growing[index];
 
 		std::vector<bool> dirs = getProbDirections(cur);
-		int count  = 0;
 		for(auto dir: dirs)
 			if(dir)
-				count++;
-		if(count > 0)
-			return cur;
+				return cur;
 
-		for(int i = 0; i < 8; i += 2){
-			Cell* nei = getNeiCell(cur, static_cast<enum Dirs>(i));
-			if(nei && nei->type == CellType::PATH && visited.find(nei) == visited.end()){
-				visited[nei] = true;
-				frontier.push_back(nei);
-			}
-		}
+		growing[index] = growing.back();
+		growing.pop_back();
 	}
 
 	return nullptr;
@@ -130,7 +130,7 @@ public:
 
 	std::function<void(void)> onDeath = [](){};
 	explicit PlayerObject(Cell* par, float size = 5.0f, glm::vec3 color = {1.0f, 0.0f, 0.0f}, float ispeed = 1.0f, int idir = 2):
-	GameObject(par), Model(), HealthObject(100.0f), DynamicDirectedObject(idir, ispeed), AnyDynamicModel(M_CANNON, size){ rotSpeed = 400.0f; addNewRotationBack(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f)); };
+	GameObject(par), Model(), HealthObject(100.0f), DynamicDirectedObject(idir, ispeed), AnyDynamicModel(M_CANNON, size){ rotSpeed = 400.0f; addRotation(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f)); };
 
 	ObjectInfo getInfo() const override{
 		return {ObjectType::PLAYER, 0};
@@ -363,6 +363,26 @@ void GameManager::setupLevelScene(){
 	debugWindow->addNewItem(new MazeUI::StatText<bool>(player->onRotate, "onRot"));
 
 	debugWindow->addNewItem(new MazeUI::StatText<int>(MazeGame::GameObject::count, "Objects"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.uploadedInstanceBytes, "Instance upload (B/frame)"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.staticMeshTriangles, "Field triangles"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.visibleInstances, "Visible instances"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.culledInstances, "Culled instances"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.culledMeshes, "Culled chunks"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.sceneRecordsPerSecond, "Scene re-records/s"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.sceneDrawCalls, "Scene draw calls"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.vertexFetchBytes, "Vertex fetch (B/frame)"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.vertexFetchBytesFull, "Vertex fetch, float layout (B/frame)"));
+	debugWindow->addNewItem(new MazeUI::StatText<float>(drawer->stats.prepareMilliseconds, "Startup (ms)"));
+	debugWindow->addNewItem(new MazeUI::StatText<float>(drawer->stats.pipelineMilliseconds, "Pipeline creation (ms)"));
+	debugWindow->addNewItem(new MazeUI::StatText<float>(drawer->stats.assetLoadMilliseconds, "Asset loading (ms)"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.memoryBlocks, "Memory blocks"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.memoryAllocations, "Pooled buffers"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.memoryUsedKB, "Buffer memory used (KB)"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.memoryReservedKB, "Buffer memory reserved (KB)"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.deviceAllocations, "vkAllocateMemory calls"));
+	debugWindow->addNewItem(new MazeUI::StatText<float>(drawer->stats.memoryFragmentation, "Memory fragmentation"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.uploadsInFlight, "Uploads in flight"));
+	debugWindow->addNewItem(new MazeUI::StatText<size_t>(drawer->stats.asyncUploadBytes, "Mesh uploads (B)"));
 	
 	debugWindow->visible = false;
 
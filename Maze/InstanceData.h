@@ -1,11 +1,66 @@
 #pragma once
 
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/gtc/quaternion.hpp>
 
+/*
+	Per-instance data as read by shaders/triangle.vert and shaders/cull.comp.
+
+	The rotation is a unit quaternion applied to the model as is. It is
+	packed into four half floats (60 bytes per instance),
+	MAZE_FLOAT_INSTANCE_ROTATION keeps it in full precision (68 bytes per
+	instance). Owners keep their full precision quaternion and only write
+	it here, reading it back is lossy in the packed format.
+
+	The instance moves from pos to to within duration seconds and spins at
+	the angular velocity spin, both starting at the scene time start (see
+	TransformSystem.h). A resting instance has pos equal to to. start lies
+	at most one epoch (about 17 minutes) before the scene time, which
+	starts over after every epoch.
+
+	layer selects the texture of the model in the texture array all models
+	share, it is the index of the model and set by InstanceStorage.
+*/
 
 struct InstanceData {
 	glm::vec3 pos = {0.0f, 0.0f, 0.0f};
-	glm::vec3 rot = {0.0f, 0.0f, 0.0f};
 	float scale = 1.0f;
+#if defined(MAZE_FLOAT_INSTANCE_ROTATION)
+	glm::vec4 rot = {0.0f, 0.0f, 0.0f, 1.0f}; // x, y, z, w
+
+	static constexpr VkFormat ROTATION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+	void setRotation(glm::quat const& q){
+		rot = glm::vec4(q.x, q.y, q.z, q.w);
+	}
+
+	glm::quat rotation() const{
+		return glm::quat(rot.w, rot.x, rot.y, rot.z);
+	}
+#else
+	uint32_t rot[2] = {0u, 0x3C000000u}; // halves of (x, y) and (z, w), identity by default
+
+	static constexpr VkFormat ROTATION_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	void setRotation(glm::quat const& q){
+		rot[0] = glm::packHalf2x16(glm::vec2(q.x, q.y));
+		rot[1] = glm::packHalf2x16(glm::vec2(q.z, q.w));
+	}
+
+	glm::quat rotation() const{
+		glm::vec2 xy = glm::unpackHalf2x16(rot[0]);
+		glm::vec2 zw = glm::unpackHalf2x16(rot[1]);
+		return glm::normalize(glm::quat(zw.y, xy.x, xy.y, zw.x));
+	}
+#endif
+
+	glm::vec3 to = {0.0f, 0.0f, 0.0f};
+	float start = 0.0f;
+	float duration = 0.0f;
+	glm::vec3 spin = {0.0f, 0.0f, 0.0f}; // radians per second
+	uint32_t layer = 0;
 };
 
 
@@ -16,16 +71,237 @@ struct InstanceBuffer {
 	VkDescriptorBufferInfo descriptor;
 };
 
+class InstanceStorage;
+
+/*
+	Stable handle to an instance kept by InstanceStorage.
+
+	It stays valid while the instance is alive no matter how the storage
+	reorders or reallocates its packed array. Once the instance is returned,
+	the handle is invalidated by the slot generation and resolves to nullptr.
+*/
+
 class InstanceView {
-	InstanceData* instance_;
+	InstanceStorage* storage_ = nullptr;
+	uint32_t slot_ = 0;
+	uint32_t generation_ = 0;
 public:
-	InstanceView(InstanceData* inst = nullptr): instance_(inst){}
-	void reset(InstanceData* newInstance = nullptr) {
-		instance_ = newInstance;
+	InstanceView() = default;
+	InstanceView(InstanceStorage* storage, uint32_t slot, uint32_t generation): storage_(storage), slot_(slot), generation_(generation){}
+
+	void reset(){
+		storage_ = nullptr;
+	}
+
+	InstanceStorage* storage() const{
+		return storage_;
+	}
+
+	uint32_t slot() const{
+		return slot_;
 	}
 
-	InstanceData* instance() const{
-		return instance_;
+	uint32_t generation() const{
+		return generation_;
+	}
+
+	bool valid() const;
+
+	// Read-only access to the instance
+	InstanceData const* instance() const;
+
+	// Write access, marks the instance to be uploaded to the GPU with the next frame
+	InstanceData* edit() const;
+
+};
+
+/*
+	Slot map of instances of one model.
+
+	Instances are kept packed in a dense array ready to be copied to the GPU,
+	slots translate stable handles into dense indices. Removal swaps the
+	last instance into the hole, so both add and remove are O(1).
+*/
+
+class InstanceStorage {
+	struct Slot{
+		uint32_t dense = 0;
+		uint32_t generation = 0;
 	};
 
+	std::vector<InstanceData> instances_;
+	std::vector<uint32_t> denseToSlot_;
+	std::vector<Slot> slots_;
+	std::vector<uint32_t> freeSlots_;
+	int model_;
+
+	// Range [dirtyBegin_, dirtyEnd_) of the packed array changed since the last upload
+	size_t dirtyBegin_ = 0;
+	size_t dirtyEnd_ = 0;
+
+public:
+	// Instance arrays never hold less than this number of instances
+	static constexpr size_t MIN_CAPACITY = 64;
+
+	explicit InstanceStorage(int model = -1): model_(model){}
+
+	InstanceStorage(InstanceStorage const&) = delete;
+	InstanceStorage(InstanceStorage&&) = default;
+	InstanceStorage& operator=(InstanceStorage&&) = default;
+
+	int model() const{
+		return model_;
+	}
+
+	// Grows the capacity (doubling it) so that count instances fit
+	// Returns true if the packed array was reallocated
+	bool reserve(size_t count){
+		if(count <= instances_.capacity())
+			return false;
+
+		size_t newCapacity = std::max(instances_.capacity() * 2, MIN_CAPACITY);
+		while(newCapacity < count)
+			newCapacity *= 2;
+
+		instances_.reserve(newCapacity);
+		denseToSlot_.reserve(newCapacity);
+		slots_.reserve(newCapacity);
+		return true;
+	}
+
+	InstanceView add(){
+		reserve(instances_.size() + 1);
+
+		uint32_t slot;
+		if(freeSlots_.empty()){
+			slot = static_cast<uint32_t>(slots_.size());
+			slots_.emplace_back();
+		}
+		else{
+			slot = freeSlots_.back();
+			freeSlots_.pop_back();
+		}
+
+		slots_[slot].dense = static_cast<uint32_t>(instances_.size());
+		instances_.emplace_back();
+		instances_.back().layer = model_ < 0 ? 0u : static_cast<uint32_t>(model_);
+		denseToSlot_.push_back(slot);
+		markDirty(instances_.size() - 1);
+
+		return InstanceView{this, slot, slots_[slot].generation};
+	}
+
+	void remove(InstanceView const& view){
+		if(view.storage() != this || !valid(view))
+			return;
+
+		uint32_t slot = view.slot();
+		uint32_t hole = slots_[slot].dense;
+		uint32_t last = static_cast<uint32_t>(instances_.size() - 1);
+
+		if(hole != last){
+			instances_[hole] = instances_[last];
+			denseToSlot_[hole] = denseToSlot_[last];
+			slots_[denseToSlot_[hole]].dense = hole;
+			markDirty(hole);
+		}
+		instances_.pop_back();
+		denseToSlot_.pop_back();
+
+		slots_[slot].generation++;
+		freeSlots_.push_back(slot);
+	}
+
+	bool valid(InstanceView const& view) const{
+		return view.slot() < slots_.size() && slots_[view.slot()].generation == view.generation();
+	}
+
+	InstanceData* get(InstanceView const& view){
+		return valid(view) ? &instances_[slots_[view.slot()].dense] : nullptr;
+	}
+
+	InstanceData* edit(InstanceView const& view){
+		if(!valid(view))
+			return nullptr;
+		uint32_t dense = slots_[view.slot()].dense;
+		markDirty(dense);
+		return &instances_[dense];
+	}
+
+	void markDirty(size_t index){
+		markDirty(index, index + 1);
+	}
+
+	void markDirty(size_t first, size_t last){
+		if(first >= last)
+			return;
+		if(dirtyBegin_ == dirtyEnd_){
+			dirtyBegin_ = first;
+			dirtyEnd_ = last;
+			return;
+		}
+		dirtyBegin_ = std::min(dirtyBegin_, first);
+		dirtyEnd_ = std::max(dirtyEnd_, last);
+	}
+
+	void markAllDirty(){
+		markDirty(0, instances_.size());
+	}
+
+	// Returns the number of instances changed since the last clearDirty(), first receives the first of them
+	size_t dirtyRange(size_t& first) const{
+		size_t last = std::min(dirtyEnd_, instances_.size());
+		first = dirtyBegin_;
+		return last > first ? last - first : 0;
+	}
+
+	void clearDirty(){
+		dirtyBegin_ = dirtyEnd_ = 0;
+	}
+
+	void clear(){
+		for(auto slot: denseToSlot_){
+			slots_[slot].generation++;
+			freeSlots_.push_back(slot);
+		}
+		instances_.clear();
+		denseToSlot_.clear();
+	}
+
+	size_t size() const{
+		return instances_.size();
+	}
+
+	size_t capacity() const{
+		return instances_.capacity();
+	}
+
+	bool empty() const{
+		return instances_.empty();
+	}
+
+	InstanceData const* data() const{
+		return instances_.data();
+	}
+
+	std::vector<InstanceData>::iterator begin(){
+		return instances_.begin();
+	}
+
+	std::vector<InstanceData>::iterator end(){
+		return instances_.end();
+	}
+
 };
+
+inline bool InstanceView::valid() const{
+	return storage_ && storage_->valid(*this);
+}
+
+inline InstanceData const* InstanceView::instance() const{
+	return storage_ ? storage_->get(*this) : nullptr;
+}
+
+inline InstanceData* InstanceView::edit() const{
+	return storage_ ? storage_->edit(*this) : nullptr;
+}
@@ -160,6 +160,8 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 	enum WindowStyle style = WS_WINDOWED;
 
 	int number_of_creatures = 250;
+	VulkanExample::CullingMode cullingMode = VulkanExample::CM_CPU;
+	int benchmarkThreads = 0;
 	int my_argc;
 	char** my_argv;
 
@@ -185,6 +187,24 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 			}
 			fieldSize = atoi(my_argv[i + 1]);
 		}
+		if(arg == CULLING_MODE_MSG){
+			std::string mode = i + 1 < my_argc ? my_argv[i + 1] : "";
+			if(mode == "none")
+				cullingMode = VulkanExample::CM_NONE;
+			else if(mode == "cpu")
+				cullingMode = VulkanExample::CM_CPU;
+			else if(mode == "gpu")
+				cullingMode = VulkanExample::CM_GPU;
+			else
+				std::cout << "You should input 'none', 'cpu' or 'gpu' after '"<<  arg <<"' token!" << std::endl;
+		}
+		if(arg == RECORDING_BENCHMARK_MSG){
+			if(i + 1 == my_argc){
+				std::cout << "You should input NUMBER after '"<<  arg <<"' token!" << std::endl;
+				continue;
+			}
+			benchmarkThreads = atoi(my_argv[i + 1]);
+		}
 		if(arg == DEBUG_UNIFORM_MSG_1){
 			if(i + 1 == my_argc){
 				std::cout << "You should input NUMBER after '"<<  arg <<"' token!" << std::endl;
@@ -218,6 +238,8 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 
 #endif
 
+	drawer->setCullingMode(cullingMode);
+
 //	drawer->uboVS.lodBias = 6.0f;
 
 // STEP 2: Initializing GameManager
@@ -229,6 +251,9 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 	
 	MazeGame::gameCore->initialize();
 
+	if(benchmarkThreads > 0)
+		drawer->benchmarkSceneRecording(benchmarkThreads);
+
 	MazeUI::Window* fpsWindow = new MazeUI::Window("", 0.9f, 0.0f, 0.0f, 0.0f, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar);
 	fpsWindow->addNewItem(new MazeUI::StatText<float>(MAZE_FPS, "fps"));
 	MazeUI::manager.addNewElement(fpsWindow);
@@ -5,6 +5,8 @@
 
 const char FULLSCREEN_MSG[] = "-fullscreen";
 const char FIELD_SIZE_MSG[] = "-fs";
+const char CULLING_MODE_MSG[] = "-cull"; // followed by "none", "cpu" or "gpu"
+const char RECORDING_BENCHMARK_MSG[] = "-recbench"; // followed by the maximal number of recording threads
 
 const char DEBUG_UNIFORM_MSG_1[] = "-msg1";
 const char DEBUG_UNIFORM_MSG_2[] = "-msg2";
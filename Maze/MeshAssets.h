@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include "VulkanModel.hpp"
+
+/*
+	MazeGame/Maze/MeshAssets.h
+
+	Where the meshes of the models live and how they are converted, shared by
+	the game and the asset cooker (CookAssets.cpp), so that both agree on the
+	cooked layout.
+
+	"make -f ... cook_assets" converts every model of ModelList.h into
+	data/Models/<name>.mesh. The game maps that file and uploads it as is,
+	it imports the .dae with Assimp only when the cooked file is missing or stale.
+
+*/
+
+namespace MazeGame{
+
+// Vertices are scaled by this on load
+const float MODEL_SCALE = 0.1f;
+
+inline std::string modelSourcePath(std::string const& name){
+	return "./data/Models/" + name + ".dae";
+}
+
+inline std::string modelCookedPath(std::string const& name){
+	return "./data/Models/" + name + ".mesh";
+}
+
+inline vks::ModelCreateInfo modelCreateInfo(){
+	return vks::ModelCreateInfo(MODEL_SCALE, 1.0f, 0.0f);
+}
+
+// Vertex layout for the models and the static meshes. The compact one takes 24 bytes per vertex
+// instead of 44, MAZE_FULL_VERTICES keeps all the components in floats
+inline vks::VertexLayout modelVertexLayout(){
+#if defined(MAZE_FULL_VERTICES)
+	return vks::VertexLayout({
+		vks::VERTEX_COMPONENT_POSITION,
+		vks::VERTEX_COMPONENT_NORMAL,
+		vks::VERTEX_COMPONENT_UV,
+		vks::VERTEX_COMPONENT_COLOR,
+	});
+#else
+	return vks::VertexLayout({
+		vks::VERTEX_COMPONENT_POSITION,
+		vks::VERTEX_COMPONENT_NORMAL_OCT16,
+		vks::VERTEX_COMPONENT_UV_HALF,
+		vks::VERTEX_COMPONENT_COLOR_UNORM8,
+	});
+#endif
+}
+
+};
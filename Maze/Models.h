@@ -4,6 +4,7 @@
 #include "Rotatible.h"
 #include "GameField.h"
 #include "ModelList.h"
+#include "FieldDrawer.h"
 
 /*
 	MazeGame/Maze/Models.h
@@ -48,6 +49,9 @@ struct Model : public Rotatible{
 
 	virtual void move(glm::vec3 const &shift) = 0;
 
+	// Moves from one point to another within duration seconds, drawn without further updates
+	virtual void travel(glm::vec3 const &from, glm::vec3 const &to, float duration) = 0;
+
 	virtual void setColor(glm::vec3 newColor) = 0;
 
 	virtual glm::vec3 getPosition() = 0;
@@ -55,8 +59,6 @@ struct Model : public Rotatible{
 	virtual void scale(float mult) = 0;
 
 
-	virtual void rotate(float dt) = 0;
-
 	virtual void rotate(glm::vec3 rotAxis, float angle) = 0;
 
 	virtual void faceOnAxis(glm::vec3 axis) = 0;
@@ -69,71 +71,48 @@ struct Model : public Rotatible{
 
 
 class SingleInstanceModel: public virtual Model{
-	InstanceView const* instance_;
+	InstanceView instance_;
 public:
-	SingleInstanceModel(enum ::MazeGame::ModelName modName, float scale): instance_(drawer->addInstance(static_cast<int>(modName))){ instance_->instance()->scale = scale;};
+	SingleInstanceModel(enum ::MazeGame::ModelName modName, float scale): instance_(drawer->addInstance(static_cast<int>(modName))){ instance_.edit()->scale = scale; transform_ = transforms.add(instance_);};
 	void set(glm::vec3 const &position) override{
-		instance_->instance()->pos = position;
+		transforms.setPosition(transform_, position);
 	};
 
 	void move(glm::vec3 const &shift) override{
-		instance_->instance()->pos += shift;	
+		transforms.setPosition(transform_, transforms.position(transform_) + shift);
+	};
+
+	void travel(glm::vec3 const &from, glm::vec3 const &to, float duration) override{
+		transforms.travel(transform_, from, to, duration);
 	};
 
 	void setColor(glm::vec3 newColor) override{};
 
 	glm::vec3 getPosition() override{
-		return instance_->instance()->pos;
+		return transforms.position(transform_);
 	};
 
 	void scale(float mult) override{
-		instance_->instance()->scale = mult;
+		instance_.edit()->scale = mult;
 	};
 
 	void rotate(glm::vec3 rotAxis, float angle) override{
-		glm::fquat instRot{instance_->instance()->rot};
-		instRot = glm::rotate(instRot, glm::radians(angle), rotAxis);
-		instRot = glm::normalize(instRot);
-		instance_->instance()->rot = glm::eulerAngles(instRot);
-	};
-
-
-
-	void rotate(float dt) override{
-		//instance_->instance()->rot += glm::vec3(0.0f, 1.0f * dt, 1.0f * dt);
-		for(auto& rot: rotations){
-			glm::fquat instRot{instance_->instance()->rot};
-			instance_->instance()->rot = glm::vec3{0.0f, 0.0f, 0.0f}; 
-			rotate(rot.first, rot.second * dt);
-			rotate(glm::axis(instRot), glm::degrees(glm::angle(instRot)));
-		}
+		transforms.setOrientation(transform_, transforms.orientation(transform_) * toInstanceRotation(glm::angleAxis(glm::radians(angle), glm::normalize(rotAxis))));
 	};
 
 
 	void faceOnAxis(glm::vec3 axis) override{
 		axis = glm::normalize(axis);
-/*		glm::vec3 xzProj = glm::vec3{axis.x, 0.0f, axis.z};
-		if(glm::length(xzProj) > __FLT_EPSILON__){
-			xzProj = glm::normalize(xzProj);
-		}
-
-		float xangle =  acos(glm::dot(xzProj, glm::vec3{1.0f, 0.0f, 0.0f}));
-		if(glm::dot(xzProj, glm::vec3{0.0f, 0.0f, 1.0f}) < 0.0f)
-			xangle = -xangle;
-		
-
-
-		float yangle = asin(glm::dot(axis, glm::vec3{0.0f, 1.0f, 0.0f}));
-		instance_->instance()->rot = glm::vec3{xangle, yangle, 0.0f};
-*/
-		glm::fquat instRot{glm::vec3{0.0f, 0.0f, 0.0f}};
-		instRot = glm::rotate(instRot, acos(glm::dot(axis, glm::vec3{1.0f, 0.0f, 0.0f})), glm::cross(axis, glm::vec3{1.0f, 0.0f, 0.0f}));
-		instRot = glm::normalize(instRot);
-		instance_->instance()->rot = glm::eulerAngles(instRot);
-
+		glm::vec3 x = {1.0f, 0.0f, 0.0f};
+		glm::vec3 turnAxis = glm::cross(axis, x);
+		if(glm::length(turnAxis) < 1e-6f)
+			turnAxis = {0.0f, 1.0f, 0.0f};
+		float angle = acos(glm::clamp(glm::dot(axis, x), -1.0f, 1.0f));
+		transforms.setOrientation(transform_, toInstanceRotation(glm::angleAxis(angle, glm::normalize(turnAxis))));
 	};
 
 	~SingleInstanceModel(){
+		transforms.remove(transform_);
 		drawer->returnInstance(instance_);
 	}
 };
@@ -159,14 +138,46 @@ const glm::vec3 dirNormal(int dir){
 
 class Field: public virtual Model, public MazeGame::CellField{
 
-	std::vector<InstanceView const*> walls;
-	std::vector<InstanceView const*> paths;
+	// Static meshes of a chunk of cells, see FieldDrawer.h
+	struct Chunk{
+		size_t wallMesh;
+		size_t pathMesh;
+		bool dirty = true;
+	};
+
+	std::vector<Chunk> chunks;
+	int chunksX = 0, chunksY = 0;
 
 
 	float cellSize = 10.0;//, wallHeight = 8.0;
 
+	FieldMesher mesher{cellSize, zeroLevel};
 
+	void markChunkDirty(int x, int y){
+		if(x < 0 || y < 0)
+			return;
+		int cx = x / FieldMesher::CHUNK_SIZE, cy = y / FieldMesher::CHUNK_SIZE;
+		if(cx >= chunksX || cy >= chunksY)
+			return;
+		chunks[cy * chunksX + cx].dirty = true;
+	}
 
+	// Remeshes the dirty chunks and uploads all of them at once
+	void rebuildChunks(){
+		std::vector<std::pair<size_t, MeshData>> updates;
+		for(int cy = 0; cy < chunksY; cy++)
+			for(int cx = 0; cx < chunksX; cx++){
+				Chunk& chunk = chunks[cy * chunksX + cx];
+				if(!chunk.dirty)
+					continue;
+				MeshData walls, paths;
+				mesher.buildChunk(*this, cx, cy, walls, paths);
+				updates.emplace_back(chunk.wallMesh, std::move(walls));
+				updates.emplace_back(chunk.pathMesh, std::move(paths));
+				chunk.dirty = false;
+			}
+		drawer->updateStaticMeshes(updates);
+	}
 
 public:
 	
@@ -176,6 +187,8 @@ public:
 
 	void move(glm::vec3 const &shift) {};
 
+	void travel(glm::vec3 const &from, glm::vec3 const &to, float duration) {};
+
 	void setColor(glm::vec3 newColor) {};
 
 	glm::vec3 getPosition() { return glm::vec3{0.0f, 0.0f, 0.0f};};
@@ -183,41 +196,52 @@ public:
 	void scale(float mult) {};
 
 
-	void rotate(float dt){};
-
 	void rotate(glm::vec3 rotAxis, float angle) {};
 
 	void faceOnAxis(glm::vec3 axis) {};
 
 	void recreate(){
-		for(auto& wall: walls)
-			drawer->returnInstance(wall);
-		for(auto& path: paths)
-			drawer->returnInstance(path);
-
-		for(int i = 0; i < getWidth(); i++)
-			for(int j = 0; j < getHeight(); j++)
-				if(getCell(i, j)->type == MazeGame::CellType::WALL){
-					walls.emplace_back(drawer->addInstance(MazeGame::M_WALL));
-					InstanceData* instance = (*(--walls.end()))->instance();
-					instance->pos = glm::vec3{i * cellSize, getZeroLevel() - cellSize / 2.0f, j * cellSize};
-					instance->scale = cellSize;
-				}
-				else{
-					paths.emplace_back(drawer->addInstance(MazeGame::M_PATH));
-					InstanceData* instance = (*(--paths.end()))->instance();
-					instance->pos = glm::vec3{i * cellSize, getZeroLevel() + cellSize / 2.0f, j * cellSize};
-					instance->scale = cellSize;
-				}
-				std::cout << "Field made with " << walls.size() << " walls and " << paths.size() << " paths" << std::endl;
+		clear();
+
+		chunksX = (getWidth() + FieldMesher::CHUNK_SIZE - 1) / FieldMesher::CHUNK_SIZE;
+		chunksY = (getHeight() + FieldMesher::CHUNK_SIZE - 1) / FieldMesher::CHUNK_SIZE;
+		chunks.resize(chunksX * chunksY);
+		for(auto& chunk: chunks){
+			chunk.wallMesh = drawer->addStaticMesh(MazeGame::M_WALL);
+			chunk.pathMesh = drawer->addStaticMesh(MazeGame::M_PATH);
+			chunk.dirty = true;
+		}
+
+		rebuildChunks();
 
+		// The triangles are counted once the upload of the chunks has arrived
+		std::cout << "Field made with " << chunks.size() << " chunks" << std::endl;
+
+		MazeGame::should_update_static_vertices = false;
+	}
+
+	// Rebuilds the chunks changed with setType()
+	void refresh(){
+		if(MazeGame::should_update_static_vertices){
+			rebuildChunks();
+			MazeGame::should_update_static_vertices = false;
+		}
+	}
+
+	// The cell may hide or expose a side of its neighbours, which may belong to the next chunks
+	void onCellChanged(int x, int y) override{
+		markChunkDirty(x, y);
+		for(int i = 0; i < 8; i += 2)
+			markChunkDirty(x + MazeGame::nei_dirs[i].first, y + MazeGame::nei_dirs[i].second);
 	}
 
 	void clear(){
-		for(auto& wall: walls)
-			drawer->returnInstance(wall);
-		for(auto& path: paths)
-			drawer->returnInstance(path);		
+		for(auto& chunk: chunks){
+			drawer->returnStaticMesh(chunk.wallMesh);
+			drawer->returnStaticMesh(chunk.pathMesh);
+		}
+		chunks.clear();
+		chunksX = chunksY = 0;
 	}
 
 	Field const& operator=(Field const& another) = delete;
@@ -225,18 +249,14 @@ public:
 	Field& operator=(Field&& another){
 		CellField::operator=(static_cast<CellField&&>(another));
 		if(&another != this){
-			for(auto& wall: walls){
-				drawer->returnInstance(wall);
-			}
-			for(auto& path: paths)
-				drawer->returnInstance(path);
-			paths.clear();
-			walls.clear();
-			walls = another.walls;
-			paths = another.paths;
-			another.walls.clear();
-			another.paths.clear();
+			clear();
+			chunks = std::move(another.chunks);
+			chunksX = another.chunksX;
+			chunksY = another.chunksY;
+			another.chunks.clear();
+			another.chunksX = another.chunksY = 0;
 			cellSize = another.cellSize;
+			mesher = another.mesher;
 		}
 		return *this;
 	}
@@ -255,10 +275,7 @@ public:
 	};
 
 	~Field(){
-		for(auto& wall: walls)
-			drawer->returnInstance(wall);
-		for(auto& path: paths)
-			drawer->returnInstance(path);
+		clear();
 	}
 };
 
@@ -76,6 +76,9 @@ public:
 
 	virtual bool canMove(Cell const* from, Cell const* into) = 0;
 
+	// Called once when a move from one cell to another starts, it takes 1 / speed seconds
+	virtual void onMoveStarted(int fromX, int fromY, int toX, int toY){};
+
 	int moveObj(int dir){
 		if(moving)
 			return false;
@@ -97,6 +100,7 @@ public:
 
 			progression = 0.0f;
 			moving = true;
+			onMoveStarted(xFrom, yFrom, xDest, yDest);
 			return true;
 		}
 		return false;
@@ -123,6 +127,7 @@ public:
 
 			progression = 0.0f;
 			moving = true;
+			onMoveStarted(xFrom, yFrom, xDest, yDest);
 			return true;
 		}
 		return false;
@@ -160,15 +165,19 @@ public:
 
 class ModeledObject: public virtual GameObject, public virtual Model {
 protected:
+	static glm::vec3 cellPosition(float x, float y){
+		return {x * gameCore->getCellSize(), gameCore->getZeroLevel() - 5.0f, y * gameCore->getCellSize()};
+	}
+
 	void setInPosition(){
-		set({(x) * gameCore->getCellSize(), gameCore->getZeroLevel() - 5.0f,(y) * gameCore->getCellSize()});		
+		set(cellPosition(x, y));
 	}
 public:
 	ModeledObject() {
 	};
 
+	// Spins are integrated for all models at once by triGraphic::transforms
 	void update(float dt) override{
-		rotate(dt);
 	}
 
 };
@@ -176,6 +185,7 @@ public:
 
 
 class DynamicModeledObject: public virtual ModeledObject, public DynamicObject {
+	bool placed = false;
 public:
 	explicit DynamicModeledObject(float ispeed = 1.0f):
 	DynamicObject(ispeed){
@@ -187,10 +197,19 @@ public:
 		return (into && into->type == CellType::PATH && !GameCore::isThereObjectsInCell(into)) ? true : false;
 	}
 
+	// The model is placed once, afterwards it is only told about the moves it starts
 	void update(float dt) override{
 		ModeledObject::update(dt);
 		DynamicObject::update(dt);
-		setInPosition();
+		if(!placed){
+			setInPosition();
+			placed = true;
+		}
+	}
+
+	void onMoveStarted(int fromX, int fromY, int toX, int toY) override{
+		travel(cellPosition(fromX, fromY), cellPosition(toX, toY), 1.0f / speed);
+		placed = true;
 	}
 
 	DynamicModeledObject& operator=(DynamicModeledObject&& rhs){
@@ -316,7 +335,7 @@ public:
 	int id = 0;
 
 	explicit Powerup(Cell* par = nullptr, float size = 5.0f, glm::vec3 color = {0.0f, 0.5f, 1.0f}): 
-	Model(), GameObject(par), AnyDynamicModel(M_COIN, size), ModeledObject(){ addNewRotationBack(std::make_pair(glm::vec3{0.0f, 1.0f, 0.0f}, 90.0f)); addNewRotationBack(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f));transparent_ = true; setInPosition();};
+	Model(), GameObject(par), AnyDynamicModel(M_COIN, size), ModeledObject(){ addRotation(std::make_pair(glm::vec3{0.0f, 1.0f, 0.0f}, 90.0f)); addRotation(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f));transparent_ = true; setInPosition();};
 
 	ObjectInfo getInfo() const override{
 		return {ObjectType::POWERUP, id};
@@ -339,7 +358,7 @@ class CoinObject: public ModeledObject, public Peakable, public SingleInstanceMo
 public:
 	static int count;
 	explicit CoinObject(Cell* par = nullptr, float size = 5.0f): 
-	Model(), GameObject(par), SingleInstanceModel(M_COIN, size), ModeledObject(){ addNewRotationBack(std::make_pair(glm::vec3{0.0f, 1.0f, 0.0f}, 90.0f)); transparent_ = true; count++; setInPosition();};
+	Model(), GameObject(par), SingleInstanceModel(M_COIN, size), ModeledObject(){ addRotation(std::make_pair(glm::vec3{0.0f, 1.0f, 0.0f}, 90.0f)); transparent_ = true; count++; setInPosition();};
 
 	void printObjectInfo() const override{
 		std::cout << "Coin" << std::endl;
@@ -359,8 +378,6 @@ public:
 template <typename AnyDynamicModel>
 class Seeker: public DynamicModeledObject, public AnyDynamicModel{
 	GameObject* aim;
-	std::list<Cell> path;
-	int counter = 0;
 public:
 
 	explicit Seeker(Cell* par, float size = 5.0f, float ispeed = 1.0f, glm::vec3 color = {1.0f, 1.0f, 1.0f}, GameObject* iaim = NULL): 
@@ -376,35 +393,14 @@ public:
 		aim = newAim;
 	}
 
+	// Follows the flow field toward aim that all seekers chasing it share
 	void update(float dt) override{
-		counter++;
 		DynamicModeledObject::update(dt);
-		if(!isMoving()){
-			if(!aim){
-				return;
-			}
-			if(counter > 20){
-				path = gameCore->findPath(x, y, aim->x, aim->y); /*, [this](Cell const* from, Cell const* into) -> bool{
-					return (into && into->type == CellType::PATH && !MazeGame::gameField.isThereObjectsInCell(into->x, into->y, 
-						[this](GameObject const * obj) -> bool{ return !obj->isTransparent() && !(obj == aim);})) ? true : false;
-				});
-				*/
-
-				if(!path.empty())
-					path.pop_front();
-				counter = 0;
-			}
-
-			if(!path.empty()){
-				Cell next = path.front();
-				path.pop_front();
-				moveObj(next.x, next.y);
-				if(!isMoving()){
-					path.push_front(next);
-				}
-				if(path.empty())
-					counter += 20;
-			}
+		if(!isMoving() && aim){
+			Cell* cell = getCell();
+			int step = gameCore->flowToward(aim).next(cell->x, cell->y);
+			if(step >= 0)
+				moveObj(stepDir(step));
 		}
 	};
 
@@ -543,7 +539,7 @@ class Cannon: public DynamicDirectedObject, public AnyDynamicModel {
 	static glm::vec3 constexpr stateColors[3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
 public:
 	explicit Cannon(Cell* par, float size = 5.0f, glm::vec3 color = {1.0f, 0.0f, 0.0f},float ispeed = 5.0, int idir = 2, float fr = 2.0):
-	GameObject(par), Model(), DynamicDirectedObject(idir, ispeed), AnyDynamicModel(M_CANNON, size), fire_rate(fr) { setInPosition(); addNewRotationBack(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f)); id = next_id++;};
+	GameObject(par), Model(), DynamicDirectedObject(idir, ispeed), AnyDynamicModel(M_CANNON, size), fire_rate(fr) { setInPosition(); addRotation(std::make_pair(glm::vec3{1.0f, 0.0f, 0.0f}, 90.0f)); id = next_id++;};
 
 	ObjectInfo getInfo() const override{
 		return {ObjectType::NPC, id};
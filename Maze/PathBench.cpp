@@ -0,0 +1,239 @@
+/*
+	MazeGame/Maze/PathBench.cpp
+
+	Benchmark of the path searches of CellField, built and run by
+	"make -f ... bench_paths". "PathBench <size>" stops at fields of the
+	given size, the default runs up to 4096x4096.
+
+	Every search runs the same random queries between path cells of a
+	generated maze and of an open arena. The list and hash map BFS the
+	game used before is kept as the reference the others are checked
+	against. Fields larger than 2048x2048 are only run as an arena and
+	without the reference, the flow field and the corridor graph.
+
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include "GameField.h"
+#include "CorridorGraph.h"
+#include "SectorGraph.h"
+
+bool MazeGame::should_update_static_vertices = false;
+
+using namespace MazeGame;
+
+namespace{
+
+struct Query{
+	int x1, y1, x2, y2;
+};
+
+// The former CellField::findPath, returns the number of moves or -1
+int referencePathLength(CellField const& field, Query const& q){
+	const Cell* cur = field.getCell(q.x1, q.y1);
+	const Cell* goal = field.getCell(q.x2, q.y2);
+
+	std::list<const Cell*> frontier;
+	std::unordered_map<const Cell*, bool> visited;
+	std::unordered_map<const Cell*, const Cell*> came_from;
+
+	frontier.emplace_back(cur);
+	came_from[cur] = nullptr;
+	visited[cur] = true;
+
+	while(!frontier.empty()){
+		cur = frontier.front();
+		frontier.pop_front();
+
+		if(cur == goal){
+			std::list<Cell> path;
+			for(; cur; cur = came_from[cur])
+				path.emplace_front(*cur);
+			return static_cast<int>(path.size()) - 1;
+		}
+
+		for(int i = 0; i < 8; i += 2){
+			const Cell* nei = field.getNeiCell(cur, static_cast<enum Dirs>(i));
+			if(nei && (visited.find(nei) == visited.end()) && PathRule()(cur, nei)){
+				visited[nei] = true;
+				came_from[nei] = cur;
+				frontier.emplace_back(nei);
+			}
+		}
+	}
+	return -1;
+}
+
+std::vector<Query> randomQueries(CellField& field, int count){
+	std::vector<Query> queries;
+	auto isPath = [](Cell* c){ return c->type == CellType::PATH; };
+	while(static_cast<int>(queries.size()) < count){
+		Cell* from = field.getRandomCell(isPath);
+		Cell* into = field.getRandomCell(isPath);
+		if(from && into)
+			queries.push_back({from->x, from->y, into->x, into->y});
+	}
+	return queries;
+}
+
+// Runs search over all queries, prints the mean time and work and checks the lengths against the first search.
+// A search that is not exact may return longer paths, it only has to find the same ones
+template<typename Search>
+void measure(std::string const& name, std::vector<Query> const& queries, std::vector<int>& lengths, Search search, bool profiled = true, PathStats const& stats = CellField::lastPathStats(), bool exact = true){
+	bool check = !lengths.empty();
+	int mismatches = 0;
+	long long moves = 0;
+	long long shortest = 0;
+	long long expanded = 0;
+	long long scanned = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < queries.size(); i++){
+		int length = search(queries[i]);
+		moves += std::max(length, 0);
+		expanded += stats.expanded;
+		scanned += stats.scanned;
+		if(!check)
+			lengths.push_back(length);
+		else if(exact ? lengths[i] != length : (lengths[i] < 0) != (length < 0) || length < lengths[i])
+			mismatches++;
+		else
+			shortest += std::max(lengths[i], 0);
+	}
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / queries.size();
+
+	std::cout << "    " << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+	          << std::setw(12) << us << " us/query " << std::setw(10) << moves / static_cast<long long>(queries.size()) << " moves";
+	if(profiled)
+		std::cout << std::setw(10) << expanded / static_cast<long long>(queries.size()) << " expanded" << std::setw(10) << scanned / static_cast<long long>(queries.size()) << " scanned";
+	if(!exact && shortest)
+		std::cout << "  +" << std::setprecision(2) << 100.0 * (moves - shortest) / shortest << "% moves";
+	if(mismatches)
+		std::cout << "  " << mismatches << " LENGTH MISMATCHES";
+	std::cout << std::endl;
+}
+
+void benchField(std::string const& name, CellField& field, int queryCount, bool complete){
+	std::vector<Query> queries = randomQueries(field, queryCount);
+	std::vector<int> lengths;
+	CellPath path;
+
+	std::cout << "  " << name << ", " << queries.size() << " queries" << std::endl;
+	if(complete)
+		measure("reference", queries, lengths, [&](Query const& q){ return referencePathLength(field, q); }, false);
+
+	std::pair<char const*, PathSearch> const searches[] = {{"bfs", PathSearch::BFS}, {"astar", PathSearch::ASTAR}, {"jps", PathSearch::JPS}};
+	for(auto const& search: searches)
+		measure(search.first, queries, lengths, [&](Query const& q){
+			return field.findPath(q.x1, q.y1, q.x2, q.y2, path, search.second) ? static_cast<int>(path.size()) : -1;
+		});
+
+	// One flow field serves every chaser of its target, each query here pays for a whole one
+	FlowField flow;
+	if(complete)
+		measure("flow", queries, lengths, [&](Query const& q){
+			field.buildFlowField(q.x2, q.y2, flow);
+			int x = q.x1, y = q.y1, moves = 0;
+			for(int step = flow.next(x, y); step >= 0; step = flow.next(x, y), moves++){
+				x += nei_dirs[stepDir(step)].first;
+				y += nei_dirs[stepDir(step)].second;
+			}
+			return x == q.x2 && y == q.y2 ? moves : -1;
+		}, false);
+
+	CorridorGraph corridors(field);
+	CorridorRoute route;
+	auto walkRoute = [&](Query const& q){
+		if(!corridors.findRoute(q.x1, q.y1, q.x2, q.y2, route))
+			return -1;
+		int moves = 0;
+		while(route.next(field) >= 0)
+			moves++;
+		return route.x() == q.x2 && route.y() == q.y2 ? moves : -1;
+	};
+	if(complete){
+		auto start = std::chrono::steady_clock::now();
+		corridors.build();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "    corridor graph of " << corridors.nodeCount() << " nodes and " << corridors.edgeCount() << " edges built in " << ms << " ms" << std::endl;
+		measure("corridors", queries, lengths, walkRoute, true, corridors.lastStats());
+	}
+
+	SectorGraph sectors(field);
+	auto start = std::chrono::steady_clock::now();
+	sectors.build();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "    sector graph of " << sectors.nodeCount() << " nodes built in " << ms << " ms" << std::endl;
+
+	// The route alone and the route walked to its end, which refines one piece after the other
+	SectorRoute sectorRoute;
+	auto findSectorRoute = [&](Query const& q){
+		return sectors.findRoute(q.x1, q.y1, q.x2, q.y2, sectorRoute) ? static_cast<int>(sectorRoute.size()) : -1;
+	};
+	auto walkSectorRoute = [&](Query const& q){
+		if(!sectors.findRoute(q.x1, q.y1, q.x2, q.y2, sectorRoute))
+			return -1;
+		int moves = 0;
+		while(sectorRoute.next(field) >= 0)
+			moves++;
+		return sectorRoute.x() == q.x2 && sectorRoute.y() == q.y2 ? moves : -1;
+	};
+	measure("sectors", queries, lengths, findSectorRoute, true, sectors.lastStats(), false);
+	measure("sector walk", queries, lengths, walkSectorRoute, false, sectors.lastStats(), false);
+
+	// Toggled cells are followed by the graphs, their routes have to agree with a search on the changed field
+	int const toggles = std::min(1000, field.getWidth() * field.getHeight() / 100);
+	start = std::chrono::steady_clock::now();
+	for(int i = 0; i < toggles; i++){
+		Cell* cell = field.getRandomCell();
+		field.setType(cell->x, cell->y, cell->type == CellType::PATH ? CellType::WALL : CellType::PATH);
+		if(complete)
+			corridors.cellChanged(cell->x, cell->y);
+		sectors.cellChanged(cell->x, cell->y);
+	}
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / toggles;
+	std::cout << "    " << toggles << " cells toggled, " << us << " us per setType() and graph update" << std::endl;
+
+	// The sector graph recomputes the sectors touched all at once
+	start = std::chrono::steady_clock::now();
+	sectors.update();
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "    sector graph updated in " << ms << " ms" << std::endl;
+
+	std::vector<int> changedLengths;
+	measure("bfs", queries, changedLengths, [&](Query const& q){
+		return field.findPath(q.x1, q.y1, q.x2, q.y2, path) ? static_cast<int>(path.size()) : -1;
+	});
+	if(complete)
+		measure("corridors", queries, changedLengths, walkRoute, true, corridors.lastStats());
+	measure("sectors", queries, changedLengths, findSectorRoute, true, sectors.lastStats(), false);
+	measure("sector walk", queries, changedLengths, walkSectorRoute, false, sectors.lastStats(), false);
+}
+
+}
+
+int main(int argc, char** argv){
+	int maxSize = argc > 1 ? std::stoi(argv[1]) : 4096;
+	int const sizes[] = {75, 256, 512, 1024, 2048, 4096};
+	int const queryCounts[] = {200, 100, 50, 20, 10, 10};
+
+	srand(1);
+	for(int i = 0; i < 6 && sizes[i] <= maxSize; i++){
+		int size = sizes[i];
+		bool complete = size <= 2048;
+		std::cout << size << "x" << size << std::endl;
+
+		CellField field(size, size);
+		if(complete){
+			field.generateRandomMaze();
+			benchField("maze", field, queryCounts[i], complete);
+		}
+
+		field.generateOpenSpaceArena();
+		benchField("arena", field, queryCounts[i], complete);
+	}
+	return 0;
+}
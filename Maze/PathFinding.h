@@ -0,0 +1,361 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+
+
+/*
+	MazeGame/Maze/PathFinding.h
+
+
+	Building blocks of the path searches on a CellField (see
+	CellField::findPath): the compact path they return, the queues and
+	the scratch storage they work in.
+
+	Cells are addressed by their dense index y * width + x. The scratch
+	storage belongs to the calling thread and is reused by every search
+	it runs, a generation counter marks the cells visited by the current
+	search so nothing has to be cleared between searches.
+
+*/
+
+
+namespace MazeGame{
+
+
+enum class PathSearch {BFS, ASTAR, JPS};
+
+// Work done by a search, for profiling
+struct PathStats{
+	size_t expanded = 0;	// nodes taken from the frontier and expanded
+	size_t pushed = 0;		// nodes put into the frontier
+	size_t scanned = 0;		// cells stepped over by jumps
+};
+
+// Moves of a path, a code is the direct direction (UP, RIGHT, DOWN, LEFT) divided by two
+enum PathStep: uint8_t {STEP_UP, STEP_RIGHT, STEP_DOWN, STEP_LEFT};
+
+inline int stepDir(int step){
+	return step * 2;
+}
+
+inline int reverseStep(int step){
+	return step ^ 2;
+}
+
+
+/*
+	Path as the cell it starts in and one 2-bit step code per move,
+	four moves to a byte. The start cell itself is not a move.
+*/
+
+class CellPath{
+	int startX_ = 0, startY_ = 0;
+	std::vector<uint8_t> steps_;
+	size_t size_ = 0;
+public:
+	void reset(int x, int y){
+		startX_ = x;
+		startY_ = y;
+		steps_.clear();
+		size_ = 0;
+	}
+
+	void clear(){
+		steps_.clear();
+		size_ = 0;
+	}
+
+	void reserve(size_t moves){
+		steps_.reserve((moves + 3) / 4);
+	}
+
+	void push(int step){
+		if(size_ % 4 == 0)
+			steps_.push_back(0);
+		steps_.back() |= static_cast<uint8_t>((step & 3) << (size_ % 4 * 2));
+		size_++;
+	}
+
+	int step(size_t i) const{
+		return (steps_[i / 4] >> (i % 4 * 2)) & 3;
+	}
+
+	// Number of moves
+	size_t size() const{
+		return size_;
+	}
+
+	bool empty() const{
+		return size_ == 0;
+	}
+
+	int startX() const{
+		return startX_;
+	}
+
+	int startY() const{
+		return startY_;
+	}
+
+	size_t bytes() const{
+		return steps_.size();
+	}
+};
+
+
+/*
+	FIFO of cell indices in a power of two ring, it doubles when full.
+	A breadth-first frontier is a thin band of the field, so the ring
+	stays far smaller than the field.
+*/
+
+class RingQueue{
+	std::vector<uint32_t> ring_;
+	size_t head_ = 0, size_ = 0;
+
+	void grow(){
+		std::vector<uint32_t> larger(std::max<size_t>(ring_.size() * 2, 256));
+		for(size_t i = 0; i < size_; i++)
+			larger[i] = ring_[(head_ + i) & (ring_.size() - 1)];
+		ring_.swap(larger);
+		head_ = 0;
+	}
+public:
+	void clear(){
+		head_ = size_ = 0;
+	}
+
+	void push(uint32_t index){
+		if(size_ == ring_.size())
+			grow();
+		ring_[(head_ + size_) & (ring_.size() - 1)] = index;
+		size_++;
+	}
+
+	uint32_t pop(){
+		uint32_t index = ring_[head_];
+		head_ = (head_ + 1) & (ring_.size() - 1);
+		size_--;
+		return index;
+	}
+
+	bool empty() const{
+		return size_ == 0;
+	}
+
+	size_t capacity() const{
+		return ring_.size();
+	}
+};
+
+
+/*
+	Binary min-heap of cell indices that knows the position of every cell
+	in it, so the key of a queued cell can be lowered in place.
+	Positions are only meaningful for cells pushed in the current search,
+	a cell taken out is marked CLOSED.
+*/
+
+class IndexedHeap{
+	struct Entry{
+		uint64_t key;
+		uint32_t index;
+	};
+	std::vector<Entry> heap_;
+	std::vector<uint32_t> position_;
+
+	void place(size_t at, Entry const& entry){
+		heap_[at] = entry;
+		position_[entry.index] = static_cast<uint32_t>(at);
+	}
+
+	void siftUp(size_t at){
+		Entry entry = heap_[at];
+		while(at > 0){
+			size_t parent = (at - 1) / 2;
+			if(heap_[parent].key <= entry.key)
+				break;
+			place(at, heap_[parent]);
+			at = parent;
+		}
+		place(at, entry);
+	}
+
+	void siftDown(size_t at){
+		Entry entry = heap_[at];
+		size_t size = heap_.size();
+		while(true){
+			size_t child = at * 2 + 1;
+			if(child >= size)
+				break;
+			if(child + 1 < size && heap_[child + 1].key < heap_[child].key)
+				child++;
+			if(entry.key <= heap_[child].key)
+				break;
+			place(at, heap_[child]);
+			at = child;
+		}
+		place(at, entry);
+	}
+public:
+	static constexpr uint32_t CLOSED = UINT32_MAX;
+
+	void resize(size_t cells){
+		if(position_.size() < cells)
+			position_.resize(cells);
+	}
+
+	void clear(){
+		heap_.clear();
+	}
+
+	void push(uint32_t index, uint64_t key){
+		heap_.push_back({key, index});
+		siftUp(heap_.size() - 1);
+	}
+
+	// The cell has to be queued and key must not be larger than its current one
+	void decrease(uint32_t index, uint64_t key){
+		size_t at = position_[index];
+		heap_[at].key = key;
+		siftUp(at);
+	}
+
+	uint32_t pop(){
+		uint32_t index = heap_.front().index;
+		position_[index] = CLOSED;
+		Entry last = heap_.back();
+		heap_.pop_back();
+		if(!heap_.empty()){
+			heap_.front() = last;
+			siftDown(0);
+		}
+		return index;
+	}
+
+	bool closed(uint32_t index) const{
+		return position_[index] == CLOSED;
+	}
+
+	bool empty() const{
+		return heap_.empty();
+	}
+};
+
+
+/*
+	Directions toward one target cell over the whole field, the result of
+	a single breadth-first search out of the target (see
+	CellField::buildFlowField). Every cell holds the step code of its first
+	move on a shortest way to the target, TARGET at the target itself and
+	NONE where there is no way. Anything chasing the target reads its next
+	move here instead of searching.
+*/
+
+class FlowField{
+	std::vector<uint8_t> toward_;
+	int width_ = 0, height_ = 0;
+	int targetX_ = -1, targetY_ = -1;
+	uint64_t revision_ = 0;
+public:
+	static constexpr uint8_t TARGET = 4;
+	static constexpr uint8_t NONE = 0xFF;
+
+	void reset(int width, int height, int targetX, int targetY, uint64_t revision){
+		width_ = width;
+		height_ = height;
+		targetX_ = targetX;
+		targetY_ = targetY;
+		revision_ = revision;
+		toward_.assign(static_cast<size_t>(width) * height, NONE);
+	}
+
+	// True if the directions lead to (x, y) on the field as it was at revision
+	bool leadsTo(int x, int y, uint64_t revision) const{
+		return !toward_.empty() && targetX_ == x && targetY_ == y && revision_ == revision;
+	}
+
+	bool reached(uint32_t index) const{
+		return toward_[index] != NONE;
+	}
+
+	void set(uint32_t index, uint8_t toward){
+		toward_[index] = toward;
+	}
+
+	// Step code of the next move from (x, y), -1 at the target, outside of the field or without a way
+	int next(int x, int y) const{
+		if(x < 0 || x >= width_ || y < 0 || y >= height_)
+			return -1;
+		uint8_t toward = toward_[y * width_ + x];
+		return toward < TARGET ? toward : -1;
+	}
+
+	int targetX() const{
+		return targetX_;
+	}
+
+	int targetY() const{
+		return targetY_;
+	}
+};
+
+
+/*
+	Per-thread storage of the searches, sized to the largest field seen.
+
+	A cell counts as visited only while its stamp equals the generation
+	of the running search, begin() starts a new generation instead of
+	clearing the arrays. from holds the step code that entered the cell
+	and cost its number of moves from the start. stats describes the last
+	search of the thread.
+*/
+
+struct PathScratch{
+	std::vector<uint32_t> stamp;
+	std::vector<uint8_t> from;
+	std::vector<uint32_t> cost;
+	RingQueue queue;
+	IndexedHeap open;
+	std::vector<uint8_t> steps;
+	PathStats stats;
+	uint32_t generation = 0;
+
+	void begin(size_t cells){
+		if(stamp.size() < cells){
+			stamp.resize(cells, 0);
+			from.resize(cells);
+			cost.resize(cells);
+		}
+		open.resize(cells);
+		open.clear();
+		queue.clear();
+		steps.clear();
+		stats = PathStats();
+		if(++generation == 0){
+			std::fill(stamp.begin(), stamp.end(), 0);
+			generation = 1;
+		}
+	}
+
+	bool visited(uint32_t index) const{
+		return stamp[index] == generation;
+	}
+
+	void visit(uint32_t index, int step, uint32_t moves){
+		stamp[index] = generation;
+		from[index] = static_cast<uint8_t>(step);
+		cost[index] = moves;
+	}
+
+	static PathScratch& local(){
+		thread_local PathScratch scratch;
+		return scratch;
+	}
+};
+
+
+};
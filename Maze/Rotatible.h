@@ -1,25 +1,31 @@
-#include <deque>
+#pragma once
 #include <cmath>
+#include "TransformSystem.h"
 
 namespace triGraphic {
 using Rotation = std::pair<glm::vec3, float>; // < axis, rotSpeed>
 
+// Spins are integrated by the TransformSystem, a Rotatible only holds its entry there.
+// Models with an instance register themselves, for others the rotations have no effect
 class Rotatible{
 protected:
-	std::deque<Rotation> rotations;
+	TransformSystem::Handle transform_;
 public:
+	Rotatible() = default;
 
-	void addNewRotationBack(Rotation const &rot){
-		rotations.push_back(rot);
-	};
+	// The registration belongs to the object, it is never copied
+	Rotatible& operator=(Rotatible const&){
+		return *this;
+	}
 
-	void addNewRotationFront(Rotation const &rot){
-		rotations.push_front(rot);
+	// Adds a constant spin, rotSpeed is in degrees per second
+	void addRotation(Rotation const &rot){
+		transforms.addAngularVelocity(transform_, toInstanceAxis(rot.first), glm::radians(rot.second));
 	};
 
-	virtual void rotate(float dt) = 0;
-
-	virtual ~Rotatible() {};
+	virtual ~Rotatible() {
+		transforms.remove(transform_);
+	};
 };
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,580 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "GameField.h"
+
+
+
+/*
+	MazeGame/Maze/SectorGraph.h
+
+
+	Hierarchical path search (HPA*) for large open fields, where corridor
+	contraction finds nothing to contract.
+
+	The field is cut into square sectors. Where a run of cells is open on
+	both sides of a sector border, the run gets entrances, a pair of nodes
+	facing each other across the border: one in the middle of a short run,
+	one at either end of a long one. Inside a sector every pair of its
+	nodes is linked with their distance within the sector.
+
+	A route is searched with A* over the nodes, the start and the goal are
+	linked into their sectors for the query only. It comes out as the
+	nodes it passes, a walk refines only the piece between the last node
+	and the next one, a short search within one or two sectors.
+
+	Routes are a few percent longer than the shortest path, they only
+	cross borders at entrances and the node search trades length for
+	speed. A change of a cell through setType() marks its sector and the
+	borders it lies on, the next query recomputes only those. Cells count
+	as passable the way PathRule sees them.
+
+*/
+
+
+namespace MazeGame{
+
+
+// Moves with PathRule within a box of cells, bounds included
+struct BoxRule{
+	int x0, y0, x1, y1;
+
+	bool operator()(const Cell* from, const Cell* into) const{
+		return into->x >= x0 && into->x <= x1 && into->y >= y0 && into->y <= y1 && PathRule()(from, into);
+	}
+};
+
+
+class SectorRoute{
+	friend class SectorGraph;
+
+	std::vector<uint32_t> waypoints_;	// cells, from the start over the nodes to the goal
+	int width_ = 0, height_ = 0, sectorSize_ = 1;
+	size_t size_ = 0;
+	int x_ = 0, y_ = 0;
+	size_t waypoint_ = 0;
+	CellPath piece_;
+	size_t step_ = 0;
+
+	// Searches the piece from waypoint_ to the next waypoint within their sectors
+	bool refine(CellField const& field){
+		uint32_t from = waypoints_[waypoint_], into = waypoints_[waypoint_ + 1];
+		int fromX = from % width_, fromY = from / width_;
+		int intoX = into % width_, intoY = into / width_;
+
+		BoxRule box;
+		box.x0 = std::min(fromX, intoX) / sectorSize_ * sectorSize_;
+		box.y0 = std::min(fromY, intoY) / sectorSize_ * sectorSize_;
+		box.x1 = std::min((std::max(fromX, intoX) / sectorSize_ + 1) * sectorSize_, width_) - 1;
+		box.y1 = std::min((std::max(fromY, intoY) / sectorSize_ + 1) * sectorSize_, height_) - 1;
+		step_ = 0;
+		return field.findPath(fromX, fromY, intoX, intoY, piece_, PathSearch::ASTAR, box);
+	}
+public:
+	void reset(int x, int y){
+		waypoints_.clear();
+		size_ = 0;
+		x_ = x;
+		y_ = y;
+		waypoint_ = 0;
+		piece_.reset(x, y);
+		step_ = 0;
+	}
+
+	// Number of moves
+	size_t size() const{
+		return size_;
+	}
+
+	bool empty() const{
+		return size_ == 0;
+	}
+
+	std::vector<uint32_t> const& waypoints() const{
+		return waypoints_;
+	}
+
+	// Cell the walk is in
+	int x() const{
+		return x_;
+	}
+
+	int y() const{
+		return y_;
+	}
+
+	// Step code of the next move of the walk, -1 once it has arrived. Each piece between two
+	// waypoints is searched when the walk gets to it, on the cells of field at that time
+	int next(CellField const& field){
+		while(step_ >= piece_.size()){
+			if(waypoint_ + 1 >= waypoints_.size())
+				return -1;
+			if(!refine(field)){
+				waypoint_ = waypoints_.size();
+				return -1;
+			}
+			waypoint_++;
+		}
+
+		int step = piece_.step(step_++);
+		x_ += nei_dirs[stepDir(step)].first;
+		y_ += nei_dirs[stepDir(step)].second;
+		return step;
+	}
+};
+
+
+class SectorGraph{
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	// Runs longer than this get an entrance at either end instead of one in the middle
+	static constexpr int LONG_RUN = 6;
+
+	struct Link{
+		uint32_t node;
+		uint32_t cost;
+		int x, y;	// of the node, so the search estimates it without a look at the node
+	};
+
+	struct Node{
+		uint32_t cell = NONE;
+		int x = 0, y = 0;
+		uint32_t sector = NONE;
+		Link partner;	// node across the border, one move away
+		std::vector<Link> links;	// nodes of the same sector
+	};
+
+	// State of a node in the running search
+	struct Visit{
+		uint32_t stamp = 0;
+		uint32_t cost;
+		uint32_t parent;
+	};
+
+	CellField const& field_;
+	int sectorSize_;
+	int width_ = 0, height_ = 0;
+	int sectorsX_ = 0, sectorsY_ = 0;
+	bool built_ = false;
+	uint64_t revision_ = 0;
+
+	std::vector<Node> nodes_;
+	std::vector<uint32_t> freeNodes_;
+	size_t nodeCount_ = 0;
+
+	// Entrance pairs on the border to the right and below every sector,
+	// the node in the sector itself first and the one across second
+	std::vector<std::vector<uint32_t>> rightBorder_, downBorder_;
+	std::vector<std::vector<uint32_t>> sectorNodes_;
+
+	// Changes not recomputed yet
+	std::vector<uint8_t> sectorDirty_, rightDirty_, downDirty_;
+	std::vector<uint32_t> dirtySectors_, dirtyRight_, dirtyDown_;
+
+	// Cells of the sector searched in with a frame of walls around them, by index within the frame
+	std::vector<uint8_t> sectorCells_;
+	int sectorX_ = 0, sectorY_ = 0;
+
+	// Storage of the sector searches and queries, reused between them
+	std::vector<uint32_t> distance_;
+	RingQueue queue_;
+	std::vector<Link> startLinks_, goalLinks_;
+	std::vector<Visit> visits_;
+	uint32_t generation_ = 0;
+	IndexedHeap open_;
+	PathStats stats_;
+
+	bool passable(uint32_t cell) const{
+		return field_.cellAt(cell)->type == CellType::PATH;
+	}
+
+	uint32_t sectorOf(uint32_t cell) const{
+		return (cell / width_ / sectorSize_) * sectorsX_ + cell % width_ / sectorSize_;
+	}
+
+	void markSector(uint32_t sector){
+		if(!sectorDirty_[sector]){
+			sectorDirty_[sector] = 1;
+			dirtySectors_.push_back(sector);
+		}
+	}
+
+	void markBorder(uint32_t sector, bool right){
+		std::vector<uint8_t>& dirty = right ? rightDirty_ : downDirty_;
+		if(!dirty[sector]){
+			dirty[sector] = 1;
+			(right ? dirtyRight_ : dirtyDown_).push_back(sector);
+		}
+	}
+
+	uint32_t addNode(uint32_t cell, uint32_t sector){
+		uint32_t id;
+		if(freeNodes_.empty()){
+			id = static_cast<uint32_t>(nodes_.size());
+			nodes_.emplace_back();
+		}
+		else{
+			id = freeNodes_.back();
+			freeNodes_.pop_back();
+		}
+		nodes_[id].cell = cell;
+		nodes_[id].x = cell % width_;
+		nodes_[id].y = cell / width_;
+		nodes_[id].sector = sector;
+		nodes_[id].links.clear();
+		nodeCount_++;
+		return id;
+	}
+
+	Link linkTo(uint32_t id, uint32_t cost) const{
+		return {id, cost, nodes_[id].x, nodes_[id].y};
+	}
+
+	void removeNode(uint32_t id){
+		nodes_[id].cell = NONE;
+		nodes_[id].links.clear();
+		freeNodes_.push_back(id);
+		nodeCount_--;
+	}
+
+	// Places the entrances of the border to the right of or below sector anew, the sectors
+	// on both sides lose their nodes on it and have to be linked again
+	void buildBorder(uint32_t sector, bool right){
+		std::vector<uint32_t>& border = right ? rightBorder_[sector] : downBorder_[sector];
+		for(uint32_t id: border)
+			removeNode(id);
+		border.clear();
+
+		uint32_t across = right ? sector + 1 : sector + sectorsX_;
+		markSector(sector);
+		markSector(across);
+
+		int sx = sector % sectorsX_, sy = sector / sectorsX_;
+		// First cell of the sector side along the border and the moves along and across it
+		int x = right ? (sx + 1) * sectorSize_ - 1 : sx * sectorSize_;
+		int y = right ? sy * sectorSize_ : (sy + 1) * sectorSize_ - 1;
+		int along = right ? width_ : 1;
+		int step = right ? 1 : width_;
+		int length = right ? std::min(sectorSize_, height_ - y) : std::min(sectorSize_, width_ - x);
+		uint32_t first = y * width_ + x;
+
+		auto entrance = [&](int at){
+			uint32_t cell = first + at * along;
+			uint32_t inside = addNode(cell, sector);
+			uint32_t outside = addNode(cell + step, across);
+			nodes_[inside].partner = linkTo(outside, 1);
+			nodes_[outside].partner = linkTo(inside, 1);
+			border.push_back(inside);
+			border.push_back(outside);
+		};
+
+		int run = 0;
+		for(int i = 0; i <= length; i++){
+			uint32_t cell = first + i * along;
+			if(i < length && passable(cell) && passable(cell + step)){
+				run++;
+				continue;
+			}
+			if(run > LONG_RUN){
+				entrance(i - run);
+				entrance(i - 1);
+			}
+			else if(run > 0)
+				entrance(i - run + run / 2);
+			run = 0;
+		}
+	}
+
+	void loadSector(uint32_t sector){
+		int frame = sectorSize_ + 2;
+		sectorX_ = (sector % sectorsX_) * sectorSize_;
+		sectorY_ = (sector / sectorsX_) * sectorSize_;
+		int w = std::min(sectorSize_, width_ - sectorX_), h = std::min(sectorSize_, height_ - sectorY_);
+		sectorCells_.assign(static_cast<size_t>(frame) * frame, 0);
+		for(int y = 0; y < h; y++)
+			for(int x = 0; x < w; x++)
+				sectorCells_[(y + 1) * frame + x + 1] = passable((sectorY_ + y) * width_ + sectorX_ + x);
+	}
+
+	uint32_t frameIndex(uint32_t cell) const{
+		return (cell / width_ - sectorY_ + 1) * (sectorSize_ + 2) + cell % width_ - sectorX_ + 1;
+	}
+
+	// Breadth-first search out of cell within the loaded sector, distance_ receives the moves
+	// to every cell of the frame and NONE where there is no way
+	void searchSector(uint32_t cell){
+		int frame = sectorSize_ + 2;
+		int const offsets[4] = {-frame, 1, frame, -1};
+		distance_.assign(sectorCells_.size(), NONE);
+
+		uint32_t local = frameIndex(cell);
+		distance_[local] = 0;
+		queue_.clear();
+		queue_.push(local);
+		while(!queue_.empty()){
+			local = queue_.pop();
+			for(int offset: offsets){
+				uint32_t next = local + offset;
+				if(!sectorCells_[next] || distance_[next] != NONE)
+					continue;
+				distance_[next] = distance_[local] + 1;
+				queue_.push(next);
+			}
+		}
+	}
+
+	uint32_t sectorDistance(uint32_t cell) const{
+		return distance_[frameIndex(cell)];
+	}
+
+	// Gathers the nodes of the sector from its four borders and links each pair of them
+	void linkSector(uint32_t sector){
+		std::vector<uint32_t>& own = sectorNodes_[sector];
+		own.clear();
+		int sx = sector % sectorsX_, sy = sector / sectorsX_;
+		auto gather = [&](std::vector<uint32_t> const& border, size_t first){
+			for(size_t i = first; i < border.size(); i += 2)
+				own.push_back(border[i]);
+		};
+		gather(rightBorder_[sector], 0);
+		gather(downBorder_[sector], 0);
+		if(sx > 0)
+			gather(rightBorder_[sector - 1], 1);
+		if(sy > 0)
+			gather(downBorder_[sector - sectorsX_], 1);
+
+		for(uint32_t id: own)
+			nodes_[id].links.clear();
+		loadSector(sector);
+		for(size_t i = 0; i + 1 < own.size(); i++){
+			searchSector(nodes_[own[i]].cell);
+			for(size_t j = i + 1; j < own.size(); j++){
+				uint32_t moves = sectorDistance(nodes_[own[j]].cell);
+				if(moves == NONE)
+					continue;
+				nodes_[own[i]].links.push_back(linkTo(own[j], moves));
+				nodes_[own[j]].links.push_back(linkTo(own[i], moves));
+			}
+		}
+	}
+
+	// Recomputes the borders and sectors marked as changed
+	void recompute(){
+		for(uint32_t sector: dirtyRight_){
+			buildBorder(sector, true);
+			rightDirty_[sector] = 0;
+		}
+		for(uint32_t sector: dirtyDown_){
+			buildBorder(sector, false);
+			downDirty_[sector] = 0;
+		}
+		dirtyRight_.clear();
+		dirtyDown_.clear();
+
+		for(uint32_t sector: dirtySectors_){
+			linkSector(sector);
+			sectorDirty_[sector] = 0;
+		}
+		dirtySectors_.clear();
+
+		// Search storage for every node and the goal, so no query has to grow it
+		visits_.resize(nodes_.size() + 1);
+		open_.resize(nodes_.size() + 1);
+	}
+
+	// Links cell to the nodes of its sector, the goal as well if it lies in the same sector
+	void linkQueryCell(uint32_t cell, std::vector<Link>& links, uint32_t goal, uint32_t& direct){
+		links.clear();
+		loadSector(sectorOf(cell));
+		searchSector(cell);
+		for(uint32_t id: sectorNodes_[sectorOf(cell)]){
+			uint32_t moves = sectorDistance(nodes_[id].cell);
+			if(moves != NONE)
+				links.push_back(linkTo(id, moves));
+		}
+		if(goal != NONE && sectorOf(goal) == sectorOf(cell))
+			direct = sectorDistance(goal);
+	}
+
+	// Distance to (x, y) raised by a sixteenth. On open ground countless orders of nodes are about
+	// equally long, with the bare distance the search expands every one that stays within the few
+	// moves the obstacles add. Raised, it follows the first good one, routes get about 2% longer
+	static uint32_t estimate(Link const& link, int x, int y){
+		uint32_t distance = std::abs(link.x - x) + std::abs(link.y - y);
+		return distance + distance / 16;
+	}
+
+	void relax(uint32_t id, uint32_t cost, uint32_t parent, uint32_t estimate){
+		Visit& visit = visits_[id];
+		bool seen = visit.stamp == generation_;
+		if(seen && (open_.closed(id) || visit.cost <= cost))
+			return;
+		visit.stamp = generation_;
+		visit.cost = cost;
+		visit.parent = parent;
+
+		// Among equal estimates the one with more moves (closer to the goal) first
+		uint64_t key = (static_cast<uint64_t>(cost + estimate) << 32) | (UINT32_MAX - cost);
+		if(seen)
+			open_.decrease(id, key);
+		else{
+			open_.push(id, key);
+			stats_.pushed++;
+		}
+	}
+
+public:
+	explicit SectorGraph(CellField const& field, int sectorSize = 32): field_(field), sectorSize_(sectorSize){}
+
+	SectorGraph(SectorGraph const&) = delete;
+
+	// Places the entrances and links all sectors of the field
+	void build(){
+		width_ = field_.getWidth();
+		height_ = field_.getHeight();
+		sectorsX_ = (width_ + sectorSize_ - 1) / sectorSize_;
+		sectorsY_ = (height_ + sectorSize_ - 1) / sectorSize_;
+		size_t sectors = static_cast<size_t>(sectorsX_) * sectorsY_;
+
+		nodes_.clear();
+		freeNodes_.clear();
+		nodeCount_ = 0;
+		rightBorder_.assign(sectors, {});
+		downBorder_.assign(sectors, {});
+		sectorNodes_.assign(sectors, {});
+		sectorDirty_.assign(sectors, 0);
+		rightDirty_.assign(sectors, 0);
+		downDirty_.assign(sectors, 0);
+		dirtySectors_.clear();
+		dirtyRight_.clear();
+		dirtyDown_.clear();
+
+		for(int sy = 0; sy < sectorsY_; sy++)
+			for(int sx = 0; sx < sectorsX_; sx++){
+				uint32_t sector = sy * sectorsX_ + sx;
+				if(sx + 1 < sectorsX_)
+					markBorder(sector, true);
+				if(sy + 1 < sectorsY_)
+					markBorder(sector, false);
+				markSector(sector);
+			}
+		recompute();
+
+		built_ = true;
+		revision_ = field_.revision();
+	}
+
+	// Recomputes what the cells changed since the last update touched or, if the graph missed
+	// any change, builds it anew. findRoute() updates the graph itself
+	void update(){
+		if(!built_ || revision_ != field_.revision() || width_ != field_.getWidth() || height_ != field_.getHeight())
+			build();
+		else
+			recompute();
+	}
+
+	// Follows the change of the type of one cell. Its sector and the borders it lies on are
+	// recomputed by the next update, a graph missing earlier changes is built anew then
+	void cellChanged(int x, int y){
+		if(!built_ || revision_ + 1 != field_.revision() || width_ != field_.getWidth() || height_ != field_.getHeight())
+			return;
+		revision_ = field_.revision();
+
+		int sx = x / sectorSize_, sy = y / sectorSize_;
+		uint32_t sector = sy * sectorsX_ + sx;
+		markSector(sector);
+		if(x % sectorSize_ == sectorSize_ - 1 && sx + 1 < sectorsX_)
+			markBorder(sector, true);
+		if(x % sectorSize_ == 0 && sx > 0)
+			markBorder(sector - 1, true);
+		if(y % sectorSize_ == sectorSize_ - 1 && sy + 1 < sectorsY_)
+			markBorder(sector, false);
+		if(y % sectorSize_ == 0 && sy > 0)
+			markBorder(sector - sectorsX_, false);
+	}
+
+	// Route from (x1, y1) to (x2, y2), false if there is none
+	bool findRoute(int x1, int y1, int x2, int y2, SectorRoute& route){
+		route.reset(x1, y1);
+		stats_ = PathStats();
+		if(x1 < 0 || x1 >= field_.getWidth() || y1 < 0 || y1 >= field_.getHeight() || x2 < 0 || x2 >= field_.getWidth() || y2 < 0 || y2 >= field_.getHeight())
+			return false;
+		update();
+
+		route.width_ = width_;
+		route.height_ = height_;
+		route.sectorSize_ = sectorSize_;
+
+		uint32_t start = y1 * width_ + x1;
+		uint32_t goal = y2 * width_ + x2;
+		if(start == goal)
+			return true;
+		if(!passable(start) || !passable(goal))
+			return false;
+
+		uint32_t direct = NONE, unused = NONE;
+		linkQueryCell(start, startLinks_, goal, direct);
+		linkQueryCell(goal, goalLinks_, NONE, unused);
+
+		// One more search node stands for the goal
+		uint32_t target = static_cast<uint32_t>(nodes_.size());
+		open_.clear();
+		if(++generation_ == 0){
+			for(Visit& visit: visits_)
+				visit.stamp = 0;
+			generation_ = 1;
+		}
+
+		uint32_t goalSector = sectorOf(goal);
+		for(Link const& link: startLinks_)
+			relax(link.node, link.cost, NONE, estimate(link, x2, y2));
+		if(direct != NONE)
+			relax(target, direct, NONE, 0);
+
+		while(!open_.empty()){
+			uint32_t id = open_.pop();
+			if(id == target)
+				break;
+			stats_.expanded++;
+
+			Node const& node = nodes_[id];
+			uint32_t cost = visits_[id].cost;
+			relax(node.partner.node, cost + 1, id, estimate(node.partner, x2, y2));
+			for(Link const& link: node.links)
+				relax(link.node, cost + link.cost, id, estimate(link, x2, y2));
+			if(node.sector == goalSector)
+				for(Link const& link: goalLinks_)
+					if(link.node == id)
+						relax(target, cost + link.cost, id, 0);
+		}
+
+		if(visits_[target].stamp != generation_ || !open_.closed(target))
+			return false;
+
+		route.waypoints_.push_back(goal);
+		for(uint32_t id = visits_[target].parent; id != NONE; id = visits_[id].parent)
+			route.waypoints_.push_back(nodes_[id].cell);
+		route.waypoints_.push_back(start);
+		std::reverse(route.waypoints_.begin(), route.waypoints_.end());
+		route.size_ = visits_[target].cost;
+		return true;
+	}
+
+	size_t nodeCount() const{
+		return nodeCount_;
+	}
+
+	int sectorSize() const{
+		return sectorSize_;
+	}
+
+	// Work of the last findRoute()
+	PathStats const& lastStats() const{
+		return stats_;
+	}
+};
+
+
+};
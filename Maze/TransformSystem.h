@@ -0,0 +1,250 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/gtc/constants.hpp>
+#include "InstanceData.h"
+
+/*
+	MazeGame/Maze/TransformSystem.h
+
+	Motion of all instanced models.
+
+	A model either rests or travels along a straight line from one point
+	to another, and spins at a constant angular velocity. Both are written
+	to its instance once, together with the time they started at, and the
+	vertex shader evaluates them with the scene time (see triangle.vert).
+	Instances are written only when a motion changes, never per frame.
+
+	Every change rebases the motion to the current time: the position and
+	the orientation reached by now become the new starting point.
+
+	The scene time starts over every EPOCH seconds, all motions are rebased
+	to the new start then. The times sent to the GPU stay small enough for
+	floats to resolve a frame, and a spin never runs for longer than an
+	epoch before its phase is taken into its orientation.
+
+*/
+
+namespace triGraphic{
+
+// Game rotations are expressed in the frame the former Euler angle shader rotated in,
+// instances take the rotation of the model in world space. The mapping is its own inverse
+inline glm::quat toInstanceRotation(glm::quat const& q){
+	return glm::quat(q.w, -q.z, q.y, -q.x);
+}
+
+inline glm::vec3 toInstanceAxis(glm::vec3 const& v){
+	return glm::vec3(-v.z, v.y, -v.x);
+}
+
+class TransformSystem{
+	struct Slot{
+		uint32_t dense = 0;
+		uint32_t generation = 0;
+	};
+
+	struct Motion{
+		glm::vec3 from = {0.0f, 0.0f, 0.0f};
+		glm::vec3 to = {0.0f, 0.0f, 0.0f};
+		float start = 0.0f;
+		float duration = 0.0f;
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); // at start
+		glm::vec3 spin = {0.0f, 0.0f, 0.0f}; // radians per second, in the instance frame
+	};
+
+	std::vector<Motion> motions_;
+	std::vector<InstanceView> targets_;
+
+	std::vector<uint32_t> denseToSlot_;
+	std::vector<Slot> slots_;
+	std::vector<uint32_t> freeSlots_;
+
+	// Seconds the scene time runs before it starts over, a float resolves it to 0.1 ms
+	static constexpr double EPOCH = 1024.0;
+
+	// Accumulated in double, the frames add up exactly to what the game objects count
+	double time_ = 0.0;
+
+	float now() const{
+		return static_cast<float>(time_);
+	}
+
+	// Same formulas as in triangle.vert
+	glm::vec3 positionAt(Motion const& m, float t) const{
+		if(m.duration <= 0.0f)
+			return m.to;
+		return glm::mix(m.from, m.to, glm::clamp((t - m.start) / m.duration, 0.0f, 1.0f));
+	}
+
+	glm::quat rotationAt(Motion const& m, float t) const{
+		float rate = glm::length(m.spin);
+		if(rate == 0.0f)
+			return m.rotation;
+		// The half angle is wrapped to a full period before the trigonometry, as the shader does
+		float halfAngle = glm::mod(0.5f * rate * (t - m.start), glm::two_pi<float>());
+		return glm::normalize(glm::angleAxis(2.0f * halfAngle, m.spin / rate) * m.rotation);
+	}
+
+	void rebase(Motion& m){
+		float t = now();
+		glm::vec3 position = positionAt(m, t);
+		m.rotation = rotationAt(m, t);
+		m.duration = std::max(m.start + m.duration - t, 0.0f);
+		m.from = m.duration > 0.0f ? position : m.to;
+		m.start = t;
+	}
+
+	// Starts the scene time over, every motion is rebased and its instance written again
+	void startEpoch(){
+		for(Motion& m: motions_)
+			rebase(m);
+		time_ -= EPOCH;
+		for(size_t i = 0; i < motions_.size(); i++){
+			motions_[i].start = now();
+			write(i);
+		}
+	}
+
+	void write(size_t i){
+		InstanceData* instance = targets_[i].edit();
+		if(!instance)
+			return;
+		Motion const& m = motions_[i];
+		instance->pos = m.from;
+		instance->to = m.to;
+		instance->start = m.start;
+		instance->duration = m.duration;
+		instance->spin = m.spin;
+		instance->setRotation(m.rotation);
+	}
+
+public:
+	struct Handle{
+		uint32_t slot = UINT32_MAX;
+		uint32_t generation = 0;
+	};
+
+	// Registers a model resting at its instance position, target receives its motion
+	Handle add(InstanceView const& target){
+		uint32_t slot;
+		if(freeSlots_.empty()){
+			slot = static_cast<uint32_t>(slots_.size());
+			slots_.emplace_back();
+		}
+		else{
+			slot = freeSlots_.back();
+			freeSlots_.pop_back();
+		}
+
+		slots_[slot].dense = static_cast<uint32_t>(motions_.size());
+		motions_.emplace_back();
+		targets_.push_back(target);
+		denseToSlot_.push_back(slot);
+
+		InstanceData const* instance = target.instance();
+		if(instance)
+			motions_.back().from = motions_.back().to = instance->pos;
+		motions_.back().start = now();
+		write(motions_.size() - 1);
+
+		return Handle{slot, slots_[slot].generation};
+	}
+
+	void remove(Handle& handle){
+		if(!valid(handle))
+			return;
+
+		uint32_t hole = slots_[handle.slot].dense;
+		uint32_t last = static_cast<uint32_t>(motions_.size() - 1);
+		if(hole != last){
+			motions_[hole] = motions_[last];
+			targets_[hole] = targets_[last];
+			denseToSlot_[hole] = denseToSlot_[last];
+			slots_[denseToSlot_[hole]].dense = hole;
+		}
+		motions_.pop_back();
+		targets_.pop_back();
+		denseToSlot_.pop_back();
+
+		slots_[handle.slot].generation++;
+		freeSlots_.push_back(handle.slot);
+		handle = Handle{};
+	}
+
+	bool valid(Handle const& handle) const{
+		return handle.slot < slots_.size() && slots_[handle.slot].generation == handle.generation;
+	}
+
+	// Scene time in seconds, it only runs while the game is updated and starts over every EPOCH seconds
+	void advance(float dt){
+		time_ += dt;
+		if(time_ >= EPOCH)
+			startEpoch();
+	}
+
+	float time() const{
+		return now();
+	}
+
+	glm::vec3 position(Handle const& handle) const{
+		return valid(handle) ? positionAt(motions_[slots_[handle.slot].dense], now()) : glm::vec3{0.0f, 0.0f, 0.0f};
+	}
+
+	glm::quat orientation(Handle const& handle) const{
+		return valid(handle) ? rotationAt(motions_[slots_[handle.slot].dense], now()) : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	// Stops any travel and puts the model at position
+	void setPosition(Handle const& handle, glm::vec3 const& position){
+		if(!valid(handle))
+			return;
+		size_t i = slots_[handle.slot].dense;
+		Motion& m = motions_[i];
+		rebase(m);
+		m.from = m.to = position;
+		m.duration = 0.0f;
+		write(i);
+	}
+
+	// Moves the model from one point to another within duration seconds, starting now
+	void travel(Handle const& handle, glm::vec3 const& from, glm::vec3 const& to, float duration){
+		if(!valid(handle))
+			return;
+		size_t i = slots_[handle.slot].dense;
+		Motion& m = motions_[i];
+		rebase(m);
+		m.from = from;
+		m.to = to;
+		m.duration = std::max(duration, 0.0f);
+		write(i);
+	}
+
+	void setOrientation(Handle const& handle, glm::quat const& q){
+		if(!valid(handle))
+			return;
+		size_t i = slots_[handle.slot].dense;
+		Motion& m = motions_[i];
+		rebase(m);
+		m.rotation = glm::normalize(q);
+		write(i);
+	}
+
+	// Adds a spin around axis (in the instance frame) at the given radians per second
+	void addAngularVelocity(Handle const& handle, glm::vec3 axis, float speed){
+		if(!valid(handle) || speed == 0.0f)
+			return;
+		size_t i = slots_[handle.slot].dense;
+		Motion& m = motions_[i];
+		rebase(m);
+		m.spin += glm::normalize(axis) * speed;
+		write(i);
+	}
+
+	size_t size() const{
+		return motions_.size();
+	}
+};
+
+inline TransformSystem transforms;
+
+};
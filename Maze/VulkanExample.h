@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <vector>
 #include <list>
+#include <unordered_map>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -26,7 +27,12 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanCookedMesh.hpp"
+#include "VulkanAsyncUploader.hpp"
+#include "threadpool.hpp"
 #include "InstanceData.h"
+#include "Culling.h"
+#include "MeshAssets.h"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
@@ -42,6 +48,28 @@ struct Vertex {
 	Vertex(): color{1.0f, 1.0f, 1.0f}{		
 	}
 };
+
+// CPU side geometry of a static mesh
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// Buffer split into one region per swap chain image, so that the region of the
+// next frame can be written while the GPU still reads the ones of previous frames
+struct FrameRing {
+	vks::Buffer buffer;
+	VkDeviceSize stride = 0; // aligned size of a region, 0 if all the images share one region
+
+	VkDeviceSize offset(uint32_t frame) const{
+		return frame * stride;
+	}
+
+	char* mapped(uint32_t frame) const{
+		return static_cast<char*>(buffer.mapped) + offset(frame);
+	}
+};
+
 class VulkanExample : public VulkanExampleBase{
 
 public:
@@ -51,20 +79,225 @@ public:
 	// Per-instance data block
 	bool shouldRecreateInstances = false;
 
+	// Number of swap chain images the frame rings and command buffers were created for
+	uint32_t frameCount = 0;
+
+	// The scene of every image is kept in secondary command buffers that only depend on
+	// buffer handles and layouts, instance counts are read from indirect draw commands.
+	// They are recorded again lazily, right before their image is rendered, as the others
+	// may still be executed by frames in flight. The overlay and the primary command buffer
+	// that executes all of them are cheap and recorded every frame
+
+	// Draws recorded into one secondary command buffer: the background,
+	// the instances of all models or a batch of static meshes
+	struct SceneGroup{
+		enum Type {BACKGROUND, INSTANCES, MESHES} type = BACKGROUND;
+		std::vector<size_t> meshes;
+	};
+
+	// Static meshes (maze chunks) recorded by one job
+	static constexpr size_t MESHES_PER_GROUP = 16;
+
+	struct SceneCommands{
+		std::vector<VkCommandBuffer> groups; // group g is allocated from the pool of worker g % workers
+		size_t recorded = 0;                 // number of groups the scene was recorded into
+		bool dirty = true;
+	};
+
+	std::vector<SceneCommands> sceneCommands;
+	std::vector<VkCommandBuffer> overlayCmdBuffers;
+
+	// Groups are recorded in parallel, every worker records from its own command pool
+	vks::ThreadPool threadPool;
+	std::vector<VkCommandPool> workerCmdPools;
+
+	// Scene recordings counted during the current second
+	struct {
+		size_t scene = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	} recordCounter;
+
+	// Counters shown in the debug window
+	struct {
+		size_t uploadedInstanceBytes = 0; // instance data copied to the GPU during the last frame
+		size_t staticMeshTriangles = 0; // triangles in all static meshes
+		size_t visibleInstances = 0;
+		size_t culledInstances = 0;
+		size_t culledMeshes = 0;
+		size_t sceneRecordsPerSecond = 0; // scene command buffers recorded again during the last second
+		size_t sceneDrawCalls = 0; // draw commands in the last recorded scene
+		size_t vertexFetchBytes = 0; // vertices and indices read by the draws of the last frame, estimated
+		size_t vertexFetchBytesFull = 0; // the same with float vertices and 32 bit indices
+		float prepareMilliseconds = 0.0f; // time prepare() took at startup
+		float pipelineMilliseconds = 0.0f; // part of it spent creating pipelines
+		float assetLoadMilliseconds = 0.0f; // part of it spent loading models and textures
+		size_t memoryBlocks = 0; // device memory blocks buffers are sub-allocated from, see VulkanMemoryAllocator.hpp
+		size_t memoryAllocations = 0; // buffers living in those blocks
+		size_t memoryUsedKB = 0;
+		size_t memoryReservedKB = 0; // blocks and dedicated allocations
+		size_t deviceAllocations = 0; // vkAllocateMemory calls for buffers so far
+		float memoryFragmentation = 0.0f;
+		size_t asyncUploadBytes = 0; // static mesh geometry sent to the transfer queue so far
+		size_t uploadsInFlight = 0; // uploads on the transfer queue that haven't finished
+	} stats;
+
+	// Refreshes the memory counters of the debug window
+	void updateMemoryStats()
+	{
+		vks::MemoryAllocator::Stats memory = vulkanDevice->memoryAllocator.stats();
+		stats.memoryBlocks = memory.blocks;
+		stats.memoryAllocations = memory.allocations;
+		stats.memoryUsedKB = memory.usedBytes / 1024;
+		stats.memoryReservedKB = memory.reservedBytes / 1024;
+		stats.deviceAllocations = memory.deviceAllocations;
+		stats.memoryFragmentation = memory.fragmentation;
+		stats.uploadsInFlight = uploader.stats().inFlight;
+	}
+
+	// CM_CPU tests instances and static meshes against the view frustum every frame,
+	// CM_GPU culls instances in a compute shader (shaders/cull.comp) and draws them indirectly
+	enum CullingMode {CM_NONE, CM_CPU, CM_GPU};
+
+	CullingMode cullingMode = CM_CPU;
+
+	void setCullingMode(CullingMode mode){
+		if(mode == CM_GPU && !gpuCulling.supported){
+			std::cout << "GPU culling is not supported by the graphics queue, using CPU culling" << std::endl;
+			mode = CM_CPU;
+		}
+		cullingMode = mode;
+		gpuCulling.outdated = true;
+		shouldRecreateInstances = true;
+	}
+
+	static_assert(sizeof(InstanceData) % sizeof(uint32_t) == 0, "cull.comp copies InstanceData as 32 bit words");
+
+	struct CullPushConstants{
+		uint32_t drawIndex;  // indirect command of the model
+		uint32_t outputBase; // first instance of the model segment in the visible buffer
+		uint32_t countIndex; // entry of the tier in instanceCounts
+		float radius;
+	};
+
+	// Resources of the CM_GPU path, every ring region is selected by dynamic descriptor offsets
+	struct {
+		bool supported = false;
+		bool outdated = true; // descriptor sets or segments don't match the instance buffers
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> descriptorSets; // one per model tier
+		FrameRing visible;        // compacted instances, one segment per model
+		size_t visibleCapacity = 0;
+		FrameRing drawCommands;   // one VkDrawIndexedIndirectCommand per model, read back for stats
+		FrameRing instanceCounts; // live number of instances of every model tier
+		std::vector<size_t> segmentBase; // first instance of every model segment
+		std::vector<size_t> segmentSize;
+	} gpuCulling;
+
+	FrustumCuller culler;
+
+	// Indirect draw commands of the CPU paths, the instance counts are written every frame.
+	// A region holds the commands of all the tiers, then the culled draws of all the models,
+	// then one command per static mesh
+	struct {
+		FrameRing commands;
+		size_t capacity = 0; // commands per region
+	} indirectDraws;
+
+	size_t tierDrawIndex(size_t model, int tier) const{
+		return model * IT_LAST + tier;
+	}
+
+	size_t visibleDrawIndex(size_t model) const{
+		return models.size() * IT_LAST + model;
+	}
+
+	size_t meshDrawIndex(size_t mesh) const{
+		return models.size() * (IT_LAST + 1) + mesh;
+	}
+
+	// Dynamic instances are host visible and updated every frame by dirty ranges,
+	// static ones (the maze itself) live in device local memory and are uploaded
+	// through a staging buffer only when they change
+	enum InstanceTierType {IT_DYNAMIC, IT_STATIC, IT_LAST};
+
+	struct InstanceTier{
+		InstanceStorage instances;
+		FrameRing buffer;    // dynamic tiers have a region per image, the static one is shared
+		size_t capacity = 0; // number of instances a region can hold
+		std::vector<std::pair<size_t, size_t>> pending; // range not yet copied into the region of each image
+	};
+
 	struct Model{
 		
-		VkPipeline pipeline;
-		VkDescriptorSet descriptorSet;
-		vks::Texture2D texture;
-		vks::Model model;
+		vks::Model model; // counts, parts and dimensions, the geometry itself is in modelResources
+
+		// Location of the model in the shared index and vertex buffers
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
 
-		std::vector<InstanceData> instances;
-		std::list<InstanceView> instanceViews;
-		vks::Buffer instanceBuf;
+		std::array<InstanceTier, IT_LAST> tiers;
+
+		float boundingRadius = 0.0f; // bounding sphere of an instance with scale 1
+
+		Model() = default;
+		Model(Model&&) = default;
 
 		virtual ~Model(){};
 	};
 
+	// Prebuilt geometry (e.g. maze chunks) drawn once with the pipeline and texture of a model
+	struct StaticMesh{
+		int model = -1;
+		vks::Buffer vertices;
+		vks::Buffer indices;
+		uint32_t indexCount = 0;
+		uint32_t vertexCount = 0;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		glm::vec3 center = {0.0f, 0.0f, 0.0f};
+		float radius = 0.0f;
+		bool visible = true;
+		vks::AsyncUploader::Ticket pendingUpload = 0; // geometry on its way, it replaces this one when it arrives
+	};
+
+	std::vector<StaticMesh> staticMeshes;
+	std::vector<size_t> freeStaticMeshes;
+
+	// Static meshes and assets are uploaded on the transfer queue, the graphics queue
+	// acquires them at the start of the first frame after their upload has finished
+	vks::AsyncUploader uploader;
+
+	// Buffers replaced while frames in flight may still read them, destroyed once those are done
+	struct RetiredBuffer{
+		vks::Buffer buffer;
+		uint64_t frame;
+	};
+	std::vector<RetiredBuffer> retiredBuffers;
+	uint64_t frameCounter = 0;
+
+	void retireBuffer(vks::Buffer& buffer){
+		if(buffer.buffer != VK_NULL_HANDLE)
+			retiredBuffers.push_back({buffer, frameCounter});
+		buffer = vks::Buffer{};
+	}
+
+	// With all is true the device has to be idle
+	void destroyRetiredBuffers(bool all = false){
+		size_t kept = 0;
+		for(auto& retired: retiredBuffers){
+			if(all || retired.frame + MAX_FRAMES_IN_FLIGHT <= frameCounter)
+				retired.buffer.destroy();
+			else
+				retiredBuffers[kept++] = retired;
+		}
+		retiredBuffers.resize(kept);
+	}
+
+	// Identity instance of every model shared by its static meshes, their vertices are already
+	// in world space. Instance m only selects the texture layer of model m
+	vks::Buffer staticMeshInstance;
+
 	struct Background{
 		VkPipeline pipeline;
 		VkDescriptorSet descriptorSet;
@@ -73,28 +306,179 @@ public:
 
 	std::vector<Model> models;
 
-	void constructModel(std::string model_filename, std::string texture_filename, Model& model){
+	// Everything the models are drawn with is shared, so that all of them are drawn with one pipeline
+	// and (with multiDrawIndirect) one indirect draw. Vertices and indices of all models are merged
+	// into one pair of buffers, their textures are the layers of one array in model order
+	struct{
+		vks::Buffer vertices;
+		vks::Buffer indices;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+		vks::Texture2DArray textures;
+		VkDescriptorSet descriptorSet;
+		VkPipeline pipeline;
+	} modelResources;
+
+	// One vkCmdDrawIndexedIndirect covers all models, each command selects its segment of the visible
+	// instances with firstInstance. Without multiDrawIndirect and drawIndirectFirstInstance every model
+	// is drawn on its own with its segment selected by the binding offset
+	bool multiDrawIndirect = false;
+
+	// Instances that passed the CPU culling, one segment per model as in gpuCulling.visible
+	struct{
+		FrameRing buffer;
+		size_t capacity = 0;
+		std::vector<size_t> segmentBase;
+		std::vector<size_t> segmentSize;
+		std::vector<size_t> count; // visible instances of every model
+	} cpuVisible;
+
+	// KTX image decoded on a loader thread
+	struct DecodedTexture{
+		std::string filename;
+		gli::texture2d image;
+		float milliseconds = 0.0f;
+
+		void decode(){
+			auto start = std::chrono::steady_clock::now();
+			if(vks::tools::fileExists(filename))
+				image = gli::texture2d(gli::load(filename.c_str()));
+			milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	};
+
+	// Mesh and texture of a model decoded on loader threads, nothing of it is on the device yet
+	struct DecodedModel{
+		std::string name;
+		vks::cooked::Mesh cooked;
+		vks::Model::Data imported; // only when the cooked mesh is stale
+		bool importFailed = false;
+		std::string staleReason;
+		float meshMilliseconds = 0.0f;
+		DecodedTexture texture;
+	};
 
-		model.model.loadFromFile("./data/Models/" + model_filename + ".dae", vertexLayout, 0.1f, vulkanDevice, queue);
+	// The cooked mesh is used as it is, Assimp only runs when it is missing or stale
+	void decodeMesh(DecodedModel& decoded){
+		auto start = std::chrono::steady_clock::now();
+		vks::ModelCreateInfo createInfo = MazeGame::modelCreateInfo();
+		std::string source = MazeGame::modelSourcePath(decoded.name);
+		if(!decoded.cooked.open(MazeGame::modelCookedPath(decoded.name), source, vertexLayout, createInfo, decoded.staleReason))
+			decoded.importFailed = !vks::Model::importFromFile(source, vertexLayout, &createInfo, decoded.imported);
+		decoded.meshMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
 
-		// Textures
-		VkFormat texFormat;
-		// Get supported compressed texture format
-		
-		texFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	// Takes the counts, parts and dimensions of the model from its decoded mesh, the geometry
+	// is merged with the other models by loadAssets
+	void describeModel(DecodedModel& decoded, Model& model){
 
-		model.texture.loadFromFile("./data/Textures/" + texture_filename + ".ktx", texFormat, vulkanDevice, queue);
+		if(decoded.cooked.valid())
+			decoded.cooked.describe(model.model);
+		else{
+			if(decoded.importFailed)
+				vks::tools::exitFatal("Could not load model " + MazeGame::modelSourcePath(decoded.name), -1);
+			model.model.setData(decoded.imported);
+		}
 
+		// Vertices are rotated around the origin and scaled by 5 * instanceScale in the shader
+		model.boundingRadius = glm::length(glm::max(glm::abs(model.model.dim.min), glm::abs(model.model.dim.max))) * MazeGame::MODEL_SCALE * 5.0f;
+
+		std::cout << decoded.name << ": " << (decoded.cooked.valid() ? "cooked mesh" : "imported with Assimp (" + decoded.staleReason + ")") << " in " << decoded.meshMilliseconds << " ms, "
+			<< model.model.vertexCount << " vertices of " << vertexLayout.stride() << " bytes (" << FULL_VERTEX_SIZE << " in floats), "
+			<< (model.model.indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32) << " bit indices, texture decoded in " << decoded.texture.milliseconds << " ms" << std::endl;
+
+		if(decoded.texture.image.empty())
+			vks::tools::exitFatal("Could not load texture from " + decoded.texture.filename, -1);
 	}
 
+	// Merges the vertices and indices of all models into modelResources and their textures into
+	// the layers of one array, their data is copied when the batch is submitted.
+	// Indices are only widened to 32 bits if one of the models needs them
+	void constructModelResources(std::vector<DecodedModel>& decoded, vks::UploadBatch& batch, std::vector<std::vector<uint32_t>>& widenedIndices){
+
+		modelResources.indexType = VK_INDEX_TYPE_UINT16;
+		for(auto& model: models)
+			if(model.model.indexType == VK_INDEX_TYPE_UINT32)
+				modelResources.indexType = VK_INDEX_TYPE_UINT32;
+		VkDeviceSize indexSize = modelResources.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+		std::vector<void const*> vertexData(models.size()), indexData(models.size());
+		VkDeviceSize vertexBytes = 0, indexBytes = 0;
+		widenedIndices.resize(models.size());
+		for(size_t m = 0; m < models.size(); m++){
+			DecodedModel& source = decoded[m];
+			Model& model = models[m];
+			vertexData[m] = source.cooked.valid() ? source.cooked.vertices() : source.imported.vertices.data();
+			indexData[m] = source.cooked.valid() ? source.cooked.indices() : source.imported.indices.data();
+			if(model.model.indexType != modelResources.indexType){
+				uint16_t const* shortIndices = static_cast<uint16_t const*>(indexData[m]);
+				widenedIndices[m].assign(shortIndices, shortIndices + model.model.indexCount);
+				indexData[m] = widenedIndices[m].data();
+			}
+
+			model.firstIndex = static_cast<uint32_t>(indexBytes / indexSize);
+			model.vertexOffset = static_cast<int32_t>(vertexBytes / vertexLayout.stride());
+			vertexBytes += VkDeviceSize(model.model.vertexCount) * vertexLayout.stride();
+			indexBytes += VkDeviceSize(model.model.indexCount) * indexSize;
+		}
+
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&modelResources.vertices,
+			vertexBytes));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&modelResources.indices,
+			indexBytes));
+		for(size_t m = 0; m < models.size(); m++){
+			Model const& model = models[m];
+			batch.addBuffer(vertexData[m], VkDeviceSize(model.model.vertexCount) * vertexLayout.stride(), modelResources.vertices.buffer, VkDeviceSize(model.vertexOffset) * vertexLayout.stride());
+			batch.addBuffer(indexData[m], VkDeviceSize(model.model.indexCount) * indexSize, modelResources.indices.buffer, VkDeviceSize(model.firstIndex) * indexSize);
+		}
 
-	// Vertex layout for the models
-	vks::VertexLayout vertexLayout = vks::VertexLayout({
-		vks::VERTEX_COMPONENT_POSITION,
-		vks::VERTEX_COMPONENT_NORMAL,
-		vks::VERTEX_COMPONENT_UV,
-		vks::VERTEX_COMPONENT_COLOR,
-	});
+		// Layers of an array share their size, smaller textures are scaled up to the largest one
+		gli::extent2d extent(0, 0);
+		size_t levels = 0;
+		for(auto& model: decoded){
+			extent = glm::max(extent, model.texture.image.extent());
+			levels = std::max(levels, model.texture.image.levels());
+		}
+		std::vector<gli::texture2d> layers;
+		layers.reserve(decoded.size());
+		for(auto& model: decoded){
+			gli::texture2d const& image = model.texture.image;
+			if(image.extent() == extent && image.levels() == levels)
+				layers.push_back(image);
+			else
+				layers.push_back(vks::resizeTexture(image, extent, levels));
+		}
+		modelResources.textures.fromTextures(layers, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, batch);
+	}
+
+	// Vertex layout for the models and the static meshes, see MeshAssets.h
+	vks::VertexLayout vertexLayout = MazeGame::modelVertexLayout();
+
+	// Size of a vertex in the full float layout, for comparison in the stats
+	static constexpr uint32_t FULL_VERTEX_SIZE = sizeof(float) * 11;
+
+	// Packs the vertices of a static mesh into vertexLayout
+	std::vector<uint8_t> packVertices(std::vector<Vertex> const& vertices){
+		std::vector<uint8_t> packed;
+		packed.reserve(vertices.size() * vertexLayout.stride());
+		for(auto& vertex: vertices)
+			for(auto component: vertexLayout.components){
+				glm::vec3 value = vertex.position;
+				if(component == vks::VERTEX_COMPONENT_NORMAL || component == vks::VERTEX_COMPONENT_NORMAL_OCT16)
+					value = vertex.normal;
+				else if(component == vks::VERTEX_COMPONENT_UV || component == vks::VERTEX_COMPONENT_UV_HALF)
+					value = glm::vec3(vertex.uv, 0.0f);
+				else if(component == vks::VERTEX_COMPONENT_COLOR || component == vks::VERTEX_COMPONENT_COLOR_UNORM8)
+					value = vertex.color;
+				vks::appendComponent(packed, component, value);
+			}
+		return packed;
+	}
 
 
 	// Contains the instanced data
@@ -103,10 +487,12 @@ public:
 		glm::mat4 projectionMatrix;
 		glm::vec4 viewPos;
 		glm::vec4 lightDirection = glm::vec4(0.7f, 2.0f, 1.2f, 0.0f);
+		glm::vec4 frustumPlanes[6]; // used by the culling compute shader
+		glm::vec4 time = glm::vec4(0.0f); // x: scene time the instances are animated with
 	} uboVS;
 
 	struct {
-		vks::Buffer scene;
+		FrameRing scene;
 	} uniformBuffers;
 
 	VkPipelineLayout pipelineLayout;
@@ -125,19 +511,38 @@ public:
 
 	~VulkanExample()
 	{
-		for(auto& model: models){
-			vkDestroyPipeline(device, model.pipeline, nullptr);
-		}
+		for(auto& pipeline: pipelines)
+			vkDestroyPipeline(device, pipeline.second, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		for(auto& model: models){
-			//vkDestroyBuffer(device, model.instanceBuf.buffer, nullptr);
-			//vkFreeMemory(device, model.instanceBuf.memory, nullptr);
-			model.instanceBuf.destroy();
-			model.model.destroy();
-			model.texture.destroy();
+			for(auto& tier: model.tiers)
+				tier.buffer.buffer.destroy();
+		}
+		modelResources.vertices.destroy();
+		modelResources.indices.destroy();
+		modelResources.textures.destroy();
+		background.texture.destroy();
+		cpuVisible.buffer.buffer.destroy();
+		uploader.destroy();
+		for(auto& mesh: staticMeshes){
+			mesh.vertices.destroy();
+			mesh.indices.destroy();
+		}
+		destroyRetiredBuffers(true);
+		staticMeshInstance.destroy();
+		if(gpuCulling.supported){
+			vkDestroyPipeline(device, gpuCulling.pipeline, nullptr);
+			vkDestroyPipelineLayout(device, gpuCulling.pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, gpuCulling.descriptorSetLayout, nullptr);
+			gpuCulling.visible.buffer.destroy();
+			gpuCulling.drawCommands.buffer.destroy();
+			gpuCulling.instanceCounts.buffer.destroy();
 		}
-		uniformBuffers.scene.destroy();
+		indirectDraws.commands.buffer.destroy();
+		uniformBuffers.scene.buffer.destroy();
+		for(auto& pool: workerCmdPools)
+			vkDestroyCommandPool(device, pool, nullptr);
 	}
 
 	// Enable physical device features required for this example				
@@ -157,98 +562,393 @@ public:
 		else if (deviceFeatures.textureCompressionETC2) {
 			enabledFeatures.textureCompressionETC2 = VK_TRUE;
 		}
+		// Draw all the models with one indirect call, see multiDrawIndirect
+		if (deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance) {
+			enabledFeatures.multiDrawIndirect = VK_TRUE;
+			enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+		}
 	};	
 
+	// Invalidates the scene command buffers of all images, each one is recorded again before its next use
 	void buildCommandBuffers()
 	{
+		sceneCommands.resize(drawCmdBuffers.size());
+		for(auto& scene: sceneCommands)
+			scene.dirty = true;
+	}
+
+	VkCommandBufferBeginInfo secondaryBeginInfo(uint32_t i, VkCommandBufferInheritanceInfo& inheritanceInfo, VkCommandBufferUsageFlags flags)
+	{
+		inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = frameBuffers[i];
+
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+		return cmdBufInfo;
+	}
 
-		VkClearValue clearValues[2];
-		clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+	// Replaces the workers and their command pools, all scene command buffers are freed with the pools
+	void setRecordingThreads(uint32_t count)
+	{
+		count = std::max(count, 1u);
+		waitFramesInFlight();
+
+		for(auto& pool: workerCmdPools)
+			vkDestroyCommandPool(device, pool, nullptr);
+		workerCmdPools.resize(count);
+		for(auto& pool: workerCmdPools){
+			VkCommandPoolCreateInfo cmdPoolInfo = {};
+			cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &pool));
+		}
+		threadPool.setThreadCount(count);
 
-		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.renderArea.extent.width = width;
-		renderPassBeginInfo.renderArea.extent.height = height;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
+		for(auto& scene: sceneCommands){
+			scene.groups.clear();
+			scene.recorded = 0;
+		}
+		buildCommandBuffers();
+	}
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+	uint32_t recordingThreads() const
+	{
+		return static_cast<uint32_t>(workerCmdPools.size());
+	}
+
+	// Splits the scene into the groups recorded by the workers
+	std::vector<SceneGroup> sceneGroups() const
+	{
+		std::vector<SceneGroup> groups(1);
+
+		// Models share their buffers, texture and pipeline, so all of them are one group
+		if(!models.empty()){
+			SceneGroup group;
+			group.type = SceneGroup::INSTANCES;
+			groups.push_back(group);
+		}
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		SceneGroup group;
+		group.type = SceneGroup::MESHES;
+		for(size_t k = 0; k < staticMeshes.size(); k++){
+			if(staticMeshes[k].model < 0 || staticMeshes[k].indexCount == 0)
+				continue;
+			group.meshes.push_back(k);
+			if(group.meshes.size() == MESHES_PER_GROUP){
+				groups.push_back(group);
+				group.meshes.clear();
+			}
+		}
+		if(!group.meshes.empty())
+			groups.push_back(group);
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		return groups;
+	}
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+	// Records the scene of the image, one secondary command buffer per group, in parallel
+	void buildSceneCommandBuffers(uint32_t i)
+	{
+		SceneCommands& scene = sceneCommands[i];
+		std::vector<SceneGroup> groups = sceneGroups();
+
+		if(scene.groups.size() < groups.size()){
+			size_t first = scene.groups.size();
+			scene.groups.resize(groups.size());
+			for(size_t g = first; g < groups.size(); g++){
+				VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(workerCmdPools[g % workerCmdPools.size()], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &scene.groups[g]));
+			}
+		}
+
+		// Pool of worker t is only used by the jobs of worker t
+		std::vector<size_t> drawCalls(groups.size(), 0);
+		for(size_t g = 0; g < groups.size(); g++)
+			threadPool.threads[g % threadPool.threads.size()]->addJob([this, i, g, &scene, &groups, &drawCalls]{
+				drawCalls[g] = buildSceneGroup(i, groups[g], scene.groups[g]);
+			});
+		threadPool.wait();
+
+		stats.sceneDrawCalls = 0;
+		for(auto calls: drawCalls)
+			stats.sceneDrawCalls += calls;
+		scene.recorded = groups.size();
+		scene.dirty = false;
+		recordCounter.scene++;
+	}
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+	// Returns the number of draw commands recorded
+	size_t buildSceneGroup(uint32_t i, SceneGroup const& group, VkCommandBuffer cmdBuffer)
+	{
+		VkCommandBufferInheritanceInfo inheritanceInfo;
+		VkCommandBufferBeginInfo cmdBufInfo = secondaryBeginInfo(i, inheritanceInfo, 0);
 
-			VkDeviceSize offsets[1] = { 0 };
+		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &background.descriptorSet, 0, NULL);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, background.pipeline);
-			vkCmdDraw(drawCmdBuffers[i], 4, 1, 0, 0);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
 
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-			for(auto& model: models){
-				if(model.instances.empty())
-					continue;
+		VkDeviceSize offsets[1] = { 0 };
+		// Uniform buffer region of the image
+		uint32_t uniformOffset = static_cast<uint32_t>(uniformBuffers.scene.offset(i));
+
+		// Draws read their instance counts from the region of the image
+		bool gpuCommands = group.type == SceneGroup::INSTANCES && cullingMode == CM_GPU;
+		VkBuffer indirectBuffer = gpuCommands ? gpuCulling.drawCommands.buffer.buffer : indirectDraws.commands.buffer.buffer;
+		VkDeviceSize indirectOffset = gpuCommands ? gpuCulling.drawCommands.offset(i) : indirectDraws.commands.offset(i);
+		size_t drawCalls = 0;
+		auto drawIndirect = [&](size_t index, uint32_t count = 1){
+			vkCmdDrawIndexedIndirect(cmdBuffer, indirectBuffer, indirectOffset + index * sizeof(VkDrawIndexedIndirectCommand), count, sizeof(VkDrawIndexedIndirectCommand));
+			drawCalls++;
+		};
+
+		if(group.type == SceneGroup::BACKGROUND){
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &background.descriptorSet, 1, &uniformOffset);
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background.pipeline);
+			vkCmdDraw(cmdBuffer, 4, 1, 0, 0);
+			VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+			return 1;
+		}
+
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &modelResources.descriptorSet, 1, &uniformOffset);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, modelResources.pipeline);
+
+		if(group.type == SceneGroup::MESHES){
+			// Culled meshes are drawn with no instances
+			for(size_t k: group.meshes){
+				StaticMesh const& mesh = staticMeshes[k];
+				// Identity instance of the model selects its texture layer
+				VkDeviceSize instanceOffset = mesh.model * sizeof(InstanceData);
+				vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &staticMeshInstance.buffer, &instanceOffset);
+				vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &mesh.vertices.buffer, offsets);
+				vkCmdBindIndexBuffer(cmdBuffer, mesh.indices.buffer, 0, mesh.indexType);
+				drawIndirect(meshDrawIndex(k));
+			}
+			VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+			return drawCalls;
+		}
+
+		vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &modelResources.vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(cmdBuffer, modelResources.indices.buffer, 0, modelResources.indexType);
+
+		if(cullingMode == CM_NONE){
+			for(size_t m = 0; m < models.size(); m++)
+				for(int t = 0; t < IT_LAST; t++){
+					InstanceTier const& tier = models[m].tiers[t];
+					if(tier.capacity == 0)
+						continue;
+					// Binding point 1 : Instance data buffer
+					VkDeviceSize tierOffset = tier.buffer.offset(i);
+					vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &tier.buffer.buffer.buffer, &tierOffset);
+					drawIndirect(tierDrawIndex(m, t));
+				}
+			VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+			return drawCalls;
+		}
+
+		// Both culling paths compact the visible instances into one segment per model
+		FrameRing const& visible = cullingMode == CM_GPU ? gpuCulling.visible : cpuVisible.buffer;
+		std::vector<size_t> const& segmentBase = cullingMode == CM_GPU ? gpuCulling.segmentBase : cpuVisible.segmentBase;
+		std::vector<size_t> const& segmentSize = cullingMode == CM_GPU ? gpuCulling.segmentSize : cpuVisible.segmentSize;
+		size_t firstDraw = cullingMode == CM_GPU ? 0 : visibleDrawIndex(0);
+		// Nothing was culled into it yet
+		if(visible.buffer.buffer == VK_NULL_HANDLE || segmentSize.size() != models.size()){
+			VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+			return drawCalls;
+		}
 
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &model.descriptorSet, 0, NULL);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, model.pipeline);
-				vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &model.model.vertices.buffer, offsets);
-				// Binding point 1 : Instance data buffer
-				vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &model.instanceBuf.buffer, offsets);
-				vkCmdBindIndexBuffer(drawCmdBuffers[i], model.model.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(drawCmdBuffers[i], model.model.indexCount, model.instances.size(), 0, 0, 0);
-			
+		if(multiDrawIndirect){
+			// firstInstance of every command points into the segment of its model
+			VkDeviceSize visibleOffset = visible.offset(i);
+			vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &visible.buffer.buffer, &visibleOffset);
+			drawIndirect(firstDraw, static_cast<uint32_t>(models.size()));
+		}
+		else{
+			for(size_t m = 0; m < models.size(); m++){
+				if(segmentSize[m] == 0)
+					continue;
+				VkDeviceSize segmentOffset = visible.offset(i) + segmentBase[m] * sizeof(InstanceData);
+				vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &visible.buffer.buffer, &segmentOffset);
+				drawIndirect(firstDraw + m);
 			}
+		}
 
-			drawUI(drawCmdBuffers[i]);
+		VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+		return drawCalls;
+	}
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+	// Records the scene of every image maxThreads times with 1..maxThreads workers
+	// and prints the average time per image
+	void benchmarkSceneRecording(uint32_t maxThreads, uint32_t iterations = 100)
+	{
+		reserveIndirectDraws();
+		if(cullingMode == CM_GPU && gpuCulling.outdated)
+			updateGpuCulling();
+
+		uint32_t threads = recordingThreads();
+		std::cout << "Scene recording, " << sceneGroups().size() << " groups:" << std::endl;
+		for(uint32_t t = 1; t <= maxThreads; t++){
+			setRecordingThreads(t);
+			auto tStart = std::chrono::high_resolution_clock::now();
+			for(uint32_t it = 0; it < iterations; it++)
+				for(uint32_t i = 0; i < frameCount; i++)
+					buildSceneCommandBuffers(i);
+			auto tEnd = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(tEnd - tStart).count() / (iterations * frameCount);
+			std::cout << "  " << t << " thread(s): " << ms << " ms" << std::endl;
+		}
+		setRecordingThreads(threads);
+		recordCounter.scene = 0;
+	}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	// Records the frame of the image: culling, then the scene and the overlay inside the render pass
+	void buildFrameCommandBuffer(uint32_t i)
+	{
+		SceneCommands& scene = sceneCommands[i];
+		if(scene.dirty)
+			buildSceneCommandBuffers(i);
+
+		std::vector<VkCommandBuffer> secondaries(scene.groups.begin(), scene.groups.begin() + scene.recorded);
+		if(settings.overlay){
+			VkCommandBufferInheritanceInfo inheritanceInfo;
+			VkCommandBufferBeginInfo overlayBeginInfo = secondaryBeginInfo(i, inheritanceInfo, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+			VK_CHECK_RESULT(vkBeginCommandBuffer(overlayCmdBuffers[i], &overlayBeginInfo));
+			drawUI(overlayCmdBuffers[i], i);
+			VK_CHECK_RESULT(vkEndCommandBuffer(overlayCmdBuffers[i]));
+			secondaries.push_back(overlayCmdBuffers[i]);
 		}
+
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 0.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[i];
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+
+		uploader.recordAcquire(drawCmdBuffers[i]);
+
+		if(cullingMode == CM_GPU)
+			recordGpuCulling(drawCmdBuffers[i], i);
+
+		vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(drawCmdBuffers[i], static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		vkCmdEndRenderPass(drawCmdBuffers[i]);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 	}
 
+	// Upload of the models and textures, acquired by the first frame
+	vks::AsyncUploader::Ticket assetUpload = 0;
+
 	template<typename PairIt>
 	void loadAssets(PairIt begin, PairIt end)
 	{
-		while(begin != end){
-			models.push_back(Model{});
-			constructModel(begin->first, begin->second, (*(models.end() - 1)));
-			begin++;
-		}
+		auto loadStart = std::chrono::steady_clock::now();
 
+		size_t count = std::distance(begin, end);
+		std::vector<DecodedModel> decoded(count);
+		for(size_t i = 0; i < count; i++, begin++){
+			decoded[i].name = begin->first;
+			decoded[i].texture.filename = "./data/Textures/" + begin->second + ".ktx";
+		}
 
 		//background texture 
+		DecodedTexture backgroundImage;
+		backgroundImage.filename = "./data/Textures/Background.ktx";
 
-		background.texture.loadFromFile("./data/Textures/Background.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		// Meshes and KTX files are decoded in parallel, one job each
+		uint32_t loaderCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(2 * count + 1));
+		{
+			vks::ThreadPool loaders;
+			loaders.setThreadCount(loaderCount);
+			size_t job = 0;
+			auto addJob = [&loaders, &job](std::function<void()> function){
+				loaders.threads[job++ % loaders.threads.size()]->addJob(std::move(function));
+			};
+			for(auto& model: decoded){
+				addJob([this, &model]{ decodeMesh(model); });
+				addJob([&model]{ model.texture.decode(); });
+			}
+			addJob([&backgroundImage]{ backgroundImage.decode(); });
+			loaders.wait();
+		}
+		std::chrono::duration<float, std::milli> decodeTime = std::chrono::steady_clock::now() - loadStart;
 
+		// All copies go through one staging buffer and one command buffer on the transfer queue,
+		// prepare() only waits for them after the pipelines have been created
+		auto uploadStart = std::chrono::steady_clock::now();
+		vks::UploadBatch batch(vulkanDevice);
 
+		// Instance views point to the storages of the models, so they must never be moved
+		models.reserve(count);
+		for(auto& model: decoded){
+			models.push_back(Model{});
+			for(auto& tier: models.back().tiers)
+				tier.instances = InstanceStorage{static_cast<int>(models.size() - 1)};
+			describeModel(model, models.back());
+		}
+		std::vector<std::vector<uint32_t>> widenedIndices;
+		constructModelResources(decoded, batch, widenedIndices);
+		cpuVisible.count.assign(models.size(), 0);
+
+		// One indirect draw has to fit all the models
+		multiDrawIndirect = enabledFeatures.multiDrawIndirect && enabledFeatures.drawIndirectFirstInstance
+			&& vulkanDevice->properties.limits.maxDrawIndirectCount >= models.size();
+
+		if(backgroundImage.image.empty())
+			vks::tools::exitFatal("Could not load texture from " + backgroundImage.filename, -1);
+		background.texture.fromTexture(backgroundImage.image, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, batch);
+
+		size_t copies = batch.count();
+		VkDeviceSize staged = batch.size();
+		assetUpload = uploader.submit(batch);
+
+		std::chrono::duration<float, std::milli> uploadTime = std::chrono::steady_clock::now() - uploadStart;
+		std::chrono::duration<float, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+		stats.assetLoadMilliseconds = loadTime.count();
+		std::cout << "Background: texture decoded in " << backgroundImage.milliseconds << " ms" << std::endl;
+		std::cout << "Assets loaded in " << loadTime.count() << " ms: decoded on " << loaderCount << " threads in " << decodeTime.count() << " ms, "
+			<< copies << " copies of " << staged / 1024 << " KB staged and submitted in " << uploadTime.count() << " ms" << std::endl;
+		std::cout << "Models share " << (modelResources.indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32) << " bit indices and a texture array of " << models.size() << " layers, "
+			<< (multiDrawIndirect ? "drawn with one multi-draw indirect call" : "drawn with one indirect call each (no multiDrawIndirect)") << std::endl;
 	}
 
 	void setupDescriptorPool()
 	{
-		// Example uses one ubo 
+		// Models share one set, the background has its own
+		// and the culling compute shader one set per model tier
+		// Buffers are bound as dynamic descriptors to select the region of the image at bind time
+		size_t cullSets = models.size() * IT_LAST;
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, models.size() + 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, models.size() + 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2 + cullSets),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, cullSets * 4),
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				models.size() + 1);
+				2 + cullSets);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -257,9 +957,9 @@ public:
 	{
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
 		{
-			// Binding 0 : Vertex shader uniform buffer
+			// Binding 0 : Vertex shader uniform buffer, offset to the region of the image
 			vks::initializers::descriptorSetLayoutBinding(
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 				VK_SHADER_STAGE_VERTEX_BIT,
 				0),
 			// Binding 1 : Fragment shader combined sampler
@@ -287,24 +987,30 @@ public:
 	void setupDescriptorSet()
 	{
 		VkDescriptorSetAllocateInfo descripotrSetAllocInfo;
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets;			
 
 		descripotrSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);;
 
 
-		for(auto& model: models){
-			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &model.descriptorSet));
-			writeDescriptorSets = {			
-				vks::initializers::writeDescriptorSet(model.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),	// Binding 0 : Vertex shader uniform buffer			
-				vks::initializers::writeDescriptorSet(model.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &model.texture.descriptor)	// Binding 1 : Color map 
-			};
-			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-		}
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &modelResources.descriptorSet));
 
 			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descripotrSetAllocInfo, &background.descriptorSet));
+
+		updateDescriptorSets();
+	}
+
+	// Points the sets to the current uniform buffer, again whenever it is recreated
+	void updateDescriptorSets()
+	{
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets;			
+
+		writeDescriptorSets = {			
+			vks::initializers::writeDescriptorSet(modelResources.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	0, &uniformBuffers.scene.buffer.descriptor),	// Binding 0 : Vertex shader uniform buffer			
+			vks::initializers::writeDescriptorSet(modelResources.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &modelResources.textures.descriptor)	// Binding 1 : Texture array of all models
+		};
+		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+
 			writeDescriptorSets = {			
-				vks::initializers::writeDescriptorSet(background.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	0, &uniformBuffers.scene.descriptor),	// Binding 0 : Vertex shader uniform buffer			
+				vks::initializers::writeDescriptorSet(background.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	0, &uniformBuffers.scene.buffer.descriptor),	// Binding 0 : Vertex shader uniform buffer			
 				vks::initializers::writeDescriptorSet(background.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &background.texture.descriptor)	// Binding 1 : Color map 
 			};
 			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
@@ -382,52 +1088,65 @@ public:
 
 		VkPipelineVertexInputStateCreateInfo inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+
+		// The vertex shader decodes octahedral normals if the layout has them
+		VkBool32 octNormals = vertexLayout.components[1] == vks::VERTEX_COMPONENT_NORMAL_OCT16;
+		VkSpecializationMapEntry vertexSpecializationEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo vertexSpecializationInfo = vks::initializers::specializationInfo(1, &vertexSpecializationEntry, sizeof(VkBool32), &octNormals);
+		auto vertexAttribute = [this](uint32_t location){
+			return vks::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, location, vks::VertexLayout::componentFormat(vertexLayout.components[location]), vertexLayout.offset(location));
+		};
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 
-		for(auto& model: models){
-			// This example uses two different input states, one for the instanced part and one for non-instanced rendering
-
-			// Vertex input bindings
-			// The instancing pipeline uses a vertex input state with two bindings
-			bindingDescriptions = {
-				// Binding point 0: Mesh vertex layout description at per-vertex rate
-				vks::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, vertexLayout.stride(), VK_VERTEX_INPUT_RATE_VERTEX),
-				// Binding point 1: Instanced data at per-instance rate
-				vks::initializers::vertexInputBindingDescription(INSTANCE_BUFFER_BIND_ID, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE)
-			};
+		// All models are drawn with one pipeline, the instance selects the texture layer
+		// This example uses two different input states, one for the instanced part and one for non-instanced rendering
 
-			// Vertex attribute bindings
-			// Note that the shader declaration for per-vertex and per-instance attributes is the same, the different input rates are only stored in the bindings:
-			// instanced.vert:
-			//	layout (location = 0) in vec3 inPos;		Per-Vertex
-			//	...
-			//	layout (location = 4) in vec3 instancePos;	Per-Instance
-			attributeDescriptions = {
-				// Per-vertex attributees
-				// These are advanced for each vertex fetched by the vertex shader
-				vks::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),					// Location 0: Position			
-				vks::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3),	// Location 1: Normal			
-				vks::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 2, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 6),		// Location 2: Texture coordinates			
-				vks::initializers::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 3, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 8),	// Location 3: Color
-				// Per-Instance attributes
-				// These are fetched for each instance rendered
-				vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 4, VK_FORMAT_R32G32B32_SFLOAT, 0),					// Location 4: Position
-				vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 5, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3),	// Location 5: Rotation
-				vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 6, VK_FORMAT_R32_SFLOAT,sizeof(float) * 6),			// Location 6: Scale
-			};
-			inputState.pVertexBindingDescriptions = bindingDescriptions.data();
-			inputState.pVertexAttributeDescriptions = attributeDescriptions.data();
+		// Vertex input bindings
+		// The instancing pipeline uses a vertex input state with two bindings
+		bindingDescriptions = {
+			// Binding point 0: Mesh vertex layout description at per-vertex rate
+			vks::initializers::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, vertexLayout.stride(), VK_VERTEX_INPUT_RATE_VERTEX),
+			// Binding point 1: Instanced data at per-instance rate
+			vks::initializers::vertexInputBindingDescription(INSTANCE_BUFFER_BIND_ID, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE)
+		};
 
-			pipelineCreateInfo.pVertexInputState = &inputState;
+		// Vertex attribute bindings
+		// Note that the shader declaration for per-vertex and per-instance attributes is the same, the different input rates are only stored in the bindings:
+		// instanced.vert:
+		//	layout (location = 0) in vec3 inPos;		Per-Vertex
+		//	...
+		//	layout (location = 4) in vec3 instancePos;	Per-Instance
+		attributeDescriptions = {
+			// Per-vertex attributees
+			// These are advanced for each vertex fetched by the vertex shader
+			// Location 0: Position, 1: Normal, 2: Texture coordinates, 3: Color in the formats of vertexLayout
+			vertexAttribute(0),
+			vertexAttribute(1),
+			vertexAttribute(2),
+			vertexAttribute(3),
+			// Per-Instance attributes
+			// These are fetched for each instance rendered
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 4, VK_FORMAT_R32G32B32_SFLOAT, 0),					// Location 4: Position
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 5, InstanceData::ROTATION_FORMAT, offsetof(InstanceData, rot)),	// Location 5: Rotation quaternion
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 6, VK_FORMAT_R32_SFLOAT, offsetof(InstanceData, scale)),			// Location 6: Scale
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 7, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceData, to)),		// Location 7: Destination
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 8, VK_FORMAT_R32G32_SFLOAT, offsetof(InstanceData, start)),		// Location 8: Start time and duration
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 9, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceData, spin)),		// Location 9: Angular velocity
+			vks::initializers::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 10, VK_FORMAT_R32_UINT, offsetof(InstanceData, layer)),			// Location 10: Texture layer
+		};
+		inputState.pVertexBindingDescriptions = bindingDescriptions.data();
+		inputState.pVertexAttributeDescriptions = attributeDescriptions.data();
 
-			// Instancing pipeline
-			shaderStages[0] = loadShader("shaders/triangle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-			shaderStages[1] = loadShader("shaders/triangle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-			// Use all input bindings and attribute descriptions
-			inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-			inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &model.pipeline));
-		}
+		pipelineCreateInfo.pVertexInputState = &inputState;
+
+		// Instancing pipeline
+		shaderStages[0] = loadShader("shaders/triangle.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		shaderStages[0].pSpecializationInfo = &vertexSpecializationInfo;
+		shaderStages[1] = loadShader("shaders/triangle.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		// Use all input bindings and attribute descriptions
+		inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+		inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+		modelResources.pipeline = getPipeline(pipelineCreateInfo);
 
 		rasterizationState.cullMode = VK_CULL_MODE_NONE;
 		depthStencilState.depthWriteEnable = VK_FALSE;
@@ -435,88 +1154,207 @@ public:
 		shaderStages[1] = loadShader( "shaders/background.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 		inputState.vertexBindingDescriptionCount = 1;
 		inputState.vertexAttributeDescriptionCount = 0;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &background.pipeline));
+		background.pipeline = getPipeline(pipelineCreateInfo);
+
+	}
+
+	// Graphics pipelines by their state, models with the same state share one pipeline
+	std::unordered_map<std::string, VkPipeline> pipelines;
+
+	// Serializes everything preparePipelines may vary into a key, pointers are followed
+	static std::string pipelineStateKey(VkGraphicsPipelineCreateInfo const& info)
+	{
+		std::string key;
+		auto add = [&key](void const* data, size_t size){
+			key.append(static_cast<char const*>(data), size);
+		};
+		auto addValue = [&add](auto const& value){
+			add(&value, sizeof(value));
+		};
 
+		addValue(info.layout);
+		addValue(info.renderPass);
+		addValue(info.subpass);
+		for(uint32_t i = 0; i < info.stageCount; i++){
+			VkPipelineShaderStageCreateInfo const& stage = info.pStages[i];
+			addValue(stage.stage);
+			addValue(stage.module);
+			key.append(stage.pName);
+			if(stage.pSpecializationInfo){
+				add(stage.pSpecializationInfo->pMapEntries, stage.pSpecializationInfo->mapEntryCount * sizeof(VkSpecializationMapEntry));
+				add(stage.pSpecializationInfo->pData, stage.pSpecializationInfo->dataSize);
+			}
+		}
+		VkPipelineVertexInputStateCreateInfo const& input = *info.pVertexInputState;
+		add(input.pVertexBindingDescriptions, input.vertexBindingDescriptionCount * sizeof(VkVertexInputBindingDescription));
+		add(input.pVertexAttributeDescriptions, input.vertexAttributeDescriptionCount * sizeof(VkVertexInputAttributeDescription));
+		addValue(info.pInputAssemblyState->topology);
+		addValue(info.pRasterizationState->polygonMode);
+		addValue(info.pRasterizationState->cullMode);
+		addValue(info.pRasterizationState->frontFace);
+		addValue(info.pDepthStencilState->depthTestEnable);
+		addValue(info.pDepthStencilState->depthWriteEnable);
+		addValue(info.pDepthStencilState->depthCompareOp);
+		add(info.pColorBlendState->pAttachments, info.pColorBlendState->attachmentCount * sizeof(VkPipelineColorBlendAttachmentState));
+		addValue(info.pMultisampleState->rasterizationSamples);
+		add(info.pDynamicState->pDynamicStates, info.pDynamicState->dynamicStateCount * sizeof(VkDynamicState));
+		return key;
+	}
+
+	// Returns the pipeline with the given state, it is only created if no identical one exists yet
+	VkPipeline getPipeline(VkGraphicsPipelineCreateInfo const& info)
+	{
+		std::string key = pipelineStateKey(info);
+		auto found = pipelines.find(key);
+		if(found != pipelines.end())
+			return found->second;
+
+		VkPipeline pipeline;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &info, nullptr, &pipeline));
+		pipelines.emplace(std::move(key), pipeline);
+		return pipeline;
 	}
 
 	void prepareInstanceData()
 	{
+		// Dynamic instance buffers are host visible and persistently mapped, they only grow
+		// (doubling their capacity) when a model runs out of reserved instances.
+		// Static buffers are created with the first static instances
+		prepareFrameResources();
+
+		// The shader scales vertices by 5 * instanceScale, so 0.2 leaves them untouched
+		std::vector<InstanceData> identity(std::max<size_t>(models.size(), 1));
+		for(size_t m = 0; m < identity.size(); m++){
+			identity[m].scale = 0.2f;
+			identity[m].layer = static_cast<uint32_t>(m);
+		}
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&staticMeshInstance,
+			identity.size() * sizeof(InstanceData),
+			identity.data()));
+	}
 
-		for(auto& model: models){
-			if(model.instances.empty())
-				continue;
-			// Staging
-			// Instanced data is static, copy to device local memory 
-			// This results in better performance
+	// Blocks until the GPU is done with all frames in flight.
+	// Only needed before buffers that may be in use are destroyed or rewritten in place
+	void waitFramesInFlight()
+	{
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	}
 
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&model.instanceBuf,
-				model.instances.size() * sizeof(InstanceData),
-				model.instances.data()));
+	void destroyFrameRing(FrameRing& ring)
+	{
+		ring.buffer.destroy();
+		// destroy() keeps the handles, the ring may be destroyed again
+		ring = FrameRing{};
+	}
 
-			VK_CHECK_RESULT(model.instanceBuf.map());
-/*
-			struct {
-				VkDeviceMemory memory;
-				VkBuffer buffer;
-			} stagingBuffer;
+	// Recreates the ring with a region of regionSize bytes for every swap chain image,
+	// or a single region shared by all of them. Its descriptor covers one region
+	void createFrameRing(FrameRing& ring, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties, VkDeviceSize regionSize, VkDeviceSize alignment, bool perFrame = true)
+	{
+		destroyFrameRing(ring);
 
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				model.instanceBuf.size,
-				&stagingBuffer.buffer,
-				&stagingBuffer.memory,
-				model.instances.data()));
+		VkDeviceSize stride = (regionSize + alignment - 1) / alignment * alignment;
+		ring.stride = perFrame ? stride : 0;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, memoryProperties, &ring.buffer, perFrame ? stride * frameCount : regionSize));
+		ring.buffer.setupDescriptor(regionSize);
 
-			VK_CHECK_RESULT(vulkanDevice->createBuffer(
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				model.instanceBuf.size,
-				&model.instanceBuf.buffer,
-				&model.instanceBuf.memory));
-
-			// Copy to staging buffer
-			VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			VkBufferCopy copyRegion = { };
-			copyRegion.size = model.instanceBuf.size;
-			vkCmdCopyBuffer(
-				copyCmd,
-				stagingBuffer.buffer,
-				model.instanceBuf.buffer,
-				1,
-				&copyRegion);
+		if(memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+			VK_CHECK_RESULT(ring.buffer.map());
+	}
 
-			VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
+	// Makes sure that the buffer of the tier can hold at least count instances
+	// Returns true if the buffer was recreated
+	bool reserveInstanceBuffer(InstanceTier& tier, InstanceTierType type, size_t count){
+		if(count <= tier.capacity)
+			return false;
 
-			model.instanceBuf.descriptor.range = model.instanceBuf.size;
-			model.instanceBuf.descriptor.buffer = model.instanceBuf.buffer;
-			model.instanceBuf.descriptor.offset = 0;
+		size_t newCapacity = std::max(tier.capacity * 2, InstanceStorage::MIN_CAPACITY);
+		while(newCapacity < count)
+			newCapacity *= 2;
 
-			// Destroy staging resources
-			vkDestroyBuffer(device, stagingBuffer.buffer, nullptr);
-			vkFreeMemory(device, stagingBuffer.memory, nullptr);
-*/
+		waitFramesInFlight();
+
+		VkDeviceSize alignment = vulkanDevice->properties.limits.minStorageBufferOffsetAlignment;
+		if(type == IT_DYNAMIC){
+			createFrameRing(tier.buffer,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				newCapacity * sizeof(InstanceData), alignment);
+		}
+		else{
+			createFrameRing(tier.buffer,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				newCapacity * sizeof(InstanceData), alignment, false);
 		}
+
+		tier.capacity = newCapacity;
+		// Fresh buffer holds nothing yet
+		tier.pending.assign(frameCount, {0, 0});
+		tier.instances.markAllDirty();
+		gpuCulling.outdated = true;
+		shouldRecreateInstances = true;
+		return true;
+	}
+
+	// Copies the changed static instances into device local memory through a staging buffer.
+	// The region is shared by all images, so the frames in flight have to finish first
+	size_t uploadStaticInstances(InstanceTier& tier){
+		size_t first;
+		size_t count = tier.instances.dirtyRange(first);
+		tier.instances.clearDirty();
+		if(count == 0)
+			return 0;
+
+		size_t size = count * sizeof(InstanceData);
+
+		waitFramesInFlight();
+
+		vks::Buffer stagingBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&stagingBuffer,
+			size,
+			const_cast<InstanceData*>(tier.instances.data() + first)));
+
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.dstOffset = first * sizeof(InstanceData);
+		copyRegion.size = size;
+		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, tier.buffer.buffer.buffer, 1, &copyRegion);
+
+		vulkanDevice->flushCommandBuffer(copyCmd, queue);
+
+		stagingBuffer.destroy();
+
+		return size;
 	}
 
 	void prepareUniformBuffers()
 	{
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+		// Persistently mapped, one region per swap chain image
+		createFrameRing(uniformBuffers.scene,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.scene,
-			sizeof(uboVS)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.scene.map());
+			sizeof(uboVS), vulkanDevice->properties.limits.minUniformBufferOffsetAlignment);
 
 		updateUniformBuffers(true);
+		for(uint32_t i = 0; i < frameCount; i++)
+			memcpy(uniformBuffers.scene.mapped(i), &uboVS, sizeof(uboVS));
 	}
 
+	// Time the vertex shader animates the instances with, see TransformSystem.h
+	void setSceneTime(float time)
+	{
+		uboVS.time.x = time;
+	}
+
+	// Only updates uboVS, it is copied into the region of an image when the image is drawn
 	void updateUniformBuffers(bool viewChanged = true)
 	{
 		if (viewChanged)
@@ -528,61 +1366,483 @@ public:
 			uboVS.projectionMatrix = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 750.0f) * uboVS.projectionMatrix;
 			uboVS.viewPos = glm::vec4(-cameraPos, 0.0f);
 
+			culler.update(uboVS.projectionMatrix);
+			for(int i = 0; i < 6; i++)
+				uboVS.frustumPlanes[i] = culler.planes()[i];
+		}
+
+	}
+
+	// Copies the instances changed since the region of the image was written last time
+	void updateInstanceBuffers(uint32_t frame)
+	{
+		stats.uploadedInstanceBytes = 0;
+		for(auto& model: models){
+			InstanceTier& dynamicTier = model.tiers[IT_DYNAMIC];
+			size_t first;
+			size_t count = dynamicTier.instances.dirtyRange(first);
+			dynamicTier.instances.clearDirty();
+			// Every region has to receive the change before it is drawn
+			if(count != 0)
+				for(auto& range: dynamicTier.pending){
+					if(range.first == range.second)
+						range = {first, first + count};
+					else
+						range = {std::min(range.first, first), std::max(range.second, first + count)};
+				}
+
+			auto& range = dynamicTier.pending[frame];
+			size_t last = std::min(range.second, dynamicTier.instances.size());
+			if(last > range.first){
+				size_t offset = range.first * sizeof(InstanceData);
+				size_t size = (last - range.first) * sizeof(InstanceData);
+				memcpy(dynamicTier.buffer.mapped(frame) + offset, dynamicTier.instances.data() + range.first, size);
+				stats.uploadedInstanceBytes += size;
+			}
+			range = {0, 0};
+
+			stats.uploadedInstanceBytes += uploadStaticInstances(model.tiers[IT_STATIC]);
 		}
 
+		if(gpuCulling.instanceCounts.buffer.mapped){
+			uint32_t* counts = reinterpret_cast<uint32_t*>(gpuCulling.instanceCounts.mapped(frame));
+			for(size_t m = 0; m < models.size(); m++)
+				for(int t = 0; t < IT_LAST; t++)
+					counts[m * IT_LAST + t] = static_cast<uint32_t>(models[m].tiers[t].instances.size());
+		}
+
+
+	}
+	void prepareGpuCulling()
+	{
+		// Compute dispatches are recorded into the graphics command buffers
+		gpuCulling.supported = (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+		if(!gpuCulling.supported)
+			return;
+
+		// All bindings are dynamic, offsets select the regions of the image being recorded
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			// Binding 0 : Instances of the tier
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Binding 1 : Visible instances
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// Binding 2 : Indirect draw commands
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// Binding 3 : Scene uniform buffer with the frustum planes
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// Binding 4 : Instance counts
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+
+		VkDescriptorSetLayoutCreateInfo descriptorLayout =
+			vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), setLayoutBindings.size());
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &gpuCulling.descriptorSetLayout));
+
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullPushConstants), 0);
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&gpuCulling.descriptorSetLayout, 1);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &gpuCulling.pipelineLayout));
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(gpuCulling.pipelineLayout, 0);
+		computePipelineCreateInfo.stage = loadShader("shaders/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		// The shader copies instances word by word, whatever the rotation format is
+		uint32_t instanceLayout[2] = {
+			sizeof(InstanceData) / sizeof(uint32_t),
+			offsetof(InstanceData, to) / sizeof(uint32_t)
+		};
+		VkSpecializationMapEntry specializationEntries[2] = {
+			vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t)),
+			vks::initializers::specializationMapEntry(1, sizeof(uint32_t), sizeof(uint32_t))
+		};
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(2, specializationEntries, sizeof(instanceLayout), instanceLayout);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &gpuCulling.pipeline));
+
+		gpuCulling.descriptorSets.resize(models.size() * IT_LAST);
+		std::vector<VkDescriptorSetLayout> layouts(gpuCulling.descriptorSets.size(), gpuCulling.descriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, layouts.data(), layouts.size());
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, gpuCulling.descriptorSets.data()));
 
+		prepareGpuCullingBuffers();
 
-		memcpy(uniformBuffers.scene.mapped, &uboVS, sizeof(uboVS));
+		updateGpuCulling();
+	}
 
+	// Both are tiny and read back or written by the CPU every frame
+	void prepareGpuCullingBuffers()
+	{
+		VkDeviceSize alignment = vulkanDevice->properties.limits.minStorageBufferOffsetAlignment;
+		createFrameRing(gpuCulling.drawCommands,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			models.size() * sizeof(VkDrawIndexedIndirectCommand), alignment);
+		memset(gpuCulling.drawCommands.buffer.mapped, 0, gpuCulling.drawCommands.buffer.size);
+
+		createFrameRing(gpuCulling.instanceCounts,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			models.size() * IT_LAST * sizeof(uint32_t), alignment);
+		memset(gpuCulling.instanceCounts.buffer.mapped, 0, gpuCulling.instanceCounts.buffer.size);
 	}
 
-	void updateInstanceBuffers()
+	// Lays out the model segments of the visible buffer after instance buffers were
+	// reallocated and points the descriptor sets to the current buffers.
+	// The sets may be bound by frames in flight, so they have to finish first
+	void updateGpuCulling()
 	{
-		for(auto& model: models){
-			if(model.instances.empty())
+		if(!gpuCulling.supported)
+			return;
+
+		waitFramesInFlight();
+		gpuCulling.outdated = false;
+
+		size_t total = layoutVisibleSegments(gpuCulling.segmentBase, gpuCulling.segmentSize);
+
+		if(total > gpuCulling.visibleCapacity || gpuCulling.visible.buffer.buffer == VK_NULL_HANDLE){
+			size_t newCapacity = std::max(gpuCulling.visibleCapacity * 2, InstanceStorage::MIN_CAPACITY);
+			while(newCapacity < total)
+				newCapacity *= 2;
+
+			createFrameRing(gpuCulling.visible,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				newCapacity * sizeof(InstanceData), vulkanDevice->properties.limits.minStorageBufferOffsetAlignment);
+			gpuCulling.visibleCapacity = newCapacity;
+		}
+
+		for(size_t m = 0; m < models.size(); m++)
+			for(int t = 0; t < IT_LAST; t++){
+				InstanceTier& tier = models[m].tiers[t];
+				if(tier.capacity == 0)
+					continue;
+				VkDescriptorSet set = gpuCulling.descriptorSets[m * IT_LAST + t];
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &tier.buffer.buffer.descriptor),
+					vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, &gpuCulling.visible.buffer.descriptor),
+					vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2, &gpuCulling.drawCommands.buffer.descriptor),
+					vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 3, &uniformBuffers.scene.buffer.descriptor),
+					vks::initializers::writeDescriptorSet(set, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 4, &gpuCulling.instanceCounts.buffer.descriptor),
+				};
+				vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			}
+	}
+
+	// Gives every model a segment of a visible buffer that holds all instances of both its tiers
+	// Returns the number of instances the buffer needs
+	size_t layoutVisibleSegments(std::vector<size_t>& base, std::vector<size_t>& size) const
+	{
+		base.resize(models.size());
+		size.resize(models.size());
+		size_t total = 0;
+		for(size_t m = 0; m < models.size(); m++){
+			base[m] = total;
+			size[m] = models[m].tiers[IT_DYNAMIC].capacity + models[m].tiers[IT_STATIC].capacity;
+			total += size[m];
+		}
+		return total;
+	}
+
+	// Indirect command drawing the instances of the model in a segment of a visible buffer.
+	// Without multiDrawIndirect the segment is selected by the binding offset instead
+	VkDrawIndexedIndirectCommand visibleDrawCommand(size_t m, size_t instanceCount, size_t segmentBase) const
+	{
+		Model const& model = models[m];
+		return {model.model.indexCount, static_cast<uint32_t>(instanceCount), model.firstIndex, model.vertexOffset, multiDrawIndirect ? static_cast<uint32_t>(segmentBase) : 0u};
+	}
+
+	// Resets the indirect commands and culls every model tier into the visible buffer,
+	// all of it in the regions of the image
+	void recordGpuCulling(VkCommandBuffer cmdBuffer, uint32_t frame)
+	{
+		std::vector<VkDrawIndexedIndirectCommand> commands(models.size());
+		for(size_t m = 0; m < models.size(); m++)
+			commands[m] = visibleDrawCommand(m, 0, gpuCulling.segmentBase[m]);
+		vkCmdUpdateBuffer(cmdBuffer, gpuCulling.drawCommands.buffer.buffer, gpuCulling.drawCommands.offset(frame), commands.size() * sizeof(VkDrawIndexedIndirectCommand), commands.data());
+
+		VkMemoryBarrier barrier = vks::initializers::memoryBarrier();
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCulling.pipeline);
+		for(size_t m = 0; m < models.size(); m++)
+			for(int t = 0; t < IT_LAST; t++){
+				InstanceTier& tier = models[m].tiers[t];
+				if(tier.capacity == 0)
+					continue;
+				// Both tiers of a model append to the same indirect command
+				CullPushConstants params;
+				params.drawIndex = m;
+				params.outputBase = gpuCulling.segmentBase[m];
+				params.countIndex = m * IT_LAST + t;
+				params.radius = models[m].boundingRadius;
+				// In binding order: instances, visible, commands, uniforms, counts
+				uint32_t dynamicOffsets[5] = {
+					static_cast<uint32_t>(tier.buffer.offset(frame)),
+					static_cast<uint32_t>(gpuCulling.visible.offset(frame)),
+					static_cast<uint32_t>(gpuCulling.drawCommands.offset(frame)),
+					static_cast<uint32_t>(uniformBuffers.scene.offset(frame)),
+					static_cast<uint32_t>(gpuCulling.instanceCounts.offset(frame)),
+				};
+				vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCulling.pipelineLayout, 0, 1, &gpuCulling.descriptorSets[m * IT_LAST + t], 5, dynamicOffsets);
+				vkCmdPushConstants(cmdBuffer, gpuCulling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &params);
+				vkCmdDispatch(cmdBuffer, (tier.capacity + 63) / 64, 1, 1);
+			}
+
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Compacts the visible instances of every model into its segment of the region of the
+	// image in cpuVisible (CM_CPU) and hides static meshes outside of the frustum
+	void cullScene(uint32_t frame)
+	{
+		stats.visibleInstances = stats.culledInstances = stats.culledMeshes = 0;
+
+		if(cullingMode == CM_NONE){
+			for(auto& mesh: staticMeshes)
+				mesh.visible = true;
+			return;
+		}
+
+		if(cullingMode == CM_GPU){
+			// Counters of the last frame rendered into this image, its fence has been waited for
+			VkDrawIndexedIndirectCommand const* commands = reinterpret_cast<VkDrawIndexedIndirectCommand const*>(gpuCulling.drawCommands.mapped(frame));
+			for(size_t m = 0; m < models.size(); m++){
+				size_t total = models[m].tiers[IT_DYNAMIC].instances.size() + models[m].tiers[IT_STATIC].instances.size();
+				size_t visible = std::min<size_t>(commands[m].instanceCount, total);
+				stats.visibleInstances += visible;
+				stats.culledInstances += total - visible;
+			}
+		}
+
+		if(cullingMode == CM_CPU){
+			// Segments move whenever an instance buffer grows, the commands of every image are rewritten
+			// before they are drawn but the fallback binds the segments in the command buffers
+			std::vector<size_t> oldBase = cpuVisible.segmentBase;
+			size_t required = layoutVisibleSegments(cpuVisible.segmentBase, cpuVisible.segmentSize);
+			if(cpuVisible.segmentBase != oldBase)
+				shouldRecreateInstances = true;
+
+			if(required > cpuVisible.capacity || cpuVisible.buffer.buffer.buffer == VK_NULL_HANDLE){
+				size_t newCapacity = std::max(cpuVisible.capacity * 2, InstanceStorage::MIN_CAPACITY);
+				while(newCapacity < required)
+					newCapacity *= 2;
+
+				waitFramesInFlight();
+				createFrameRing(cpuVisible.buffer,
+					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					newCapacity * sizeof(InstanceData), sizeof(InstanceData));
+				cpuVisible.capacity = newCapacity;
+				shouldRecreateInstances = true;
+			}
+
+			InstanceData* out = reinterpret_cast<InstanceData*>(cpuVisible.buffer.mapped(frame));
+			for(size_t m = 0; m < models.size(); m++){
+				Model const& model = models[m];
+				size_t total = model.tiers[IT_DYNAMIC].instances.size() + model.tiers[IT_STATIC].instances.size();
+				size_t visible = 0;
+				InstanceData* segment = out + cpuVisible.segmentBase[m];
+				for(auto& tier: model.tiers)
+					visible += culler.cull(tier.instances.data(), tier.instances.size(), model.boundingRadius, segment + visible);
+				cpuVisible.count[m] = visible;
+
+				stats.visibleInstances += visible;
+				stats.culledInstances += total - visible;
+			}
+		}
+
+		for(auto& mesh: staticMeshes){
+			if(mesh.indexCount == 0)
 				continue;
-			memcpy(model.instanceBuf.mapped, model.instances.data(), model.instances.size() * sizeof(InstanceData));
+			mesh.visible = culler.checkSphere(mesh.center, mesh.radius);
+			if(!mesh.visible)
+				stats.culledMeshes++;
 		}
+	}
+
+	// Makes sure that a region of indirectDraws holds a command for every tier, model and static mesh
+	void reserveIndirectDraws()
+	{
+		size_t count = meshDrawIndex(staticMeshes.size());
+		if(count <= indirectDraws.capacity && indirectDraws.commands.buffer.buffer != VK_NULL_HANDLE)
+			return;
+
+		size_t newCapacity = std::max<size_t>(indirectDraws.capacity * 2, InstanceStorage::MIN_CAPACITY);
+		while(newCapacity < count)
+			newCapacity *= 2;
 
+		waitFramesInFlight();
+		createFrameRing(indirectDraws.commands,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			newCapacity * sizeof(VkDrawIndexedIndirectCommand), sizeof(VkDrawIndexedIndirectCommand));
+		indirectDraws.capacity = newCapacity;
+		shouldRecreateInstances = true;
+	}
 
+	// Writes the current instance counts into the indirect commands of the image
+	void updateIndirectDraws(uint32_t frame)
+	{
+		VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(indirectDraws.commands.mapped(frame));
+		for(size_t m = 0; m < models.size(); m++){
+			Model const& model = models[m];
+			for(int t = 0; t < IT_LAST; t++)
+				commands[tierDrawIndex(m, t)] = {model.model.indexCount, static_cast<uint32_t>(model.tiers[t].instances.size()), model.firstIndex, model.vertexOffset, 0};
+			size_t segmentBase = m < cpuVisible.segmentBase.size() ? cpuVisible.segmentBase[m] : 0;
+			commands[visibleDrawIndex(m)] = visibleDrawCommand(m, cpuVisible.count[m], segmentBase);
+		}
+		for(size_t k = 0; k < staticMeshes.size(); k++)
+			commands[meshDrawIndex(k)] = {staticMeshes[k].indexCount, staticMeshes[k].visible ? 1u : 0u, 0, 0, 0};
+
+		// Every drawn instance is counted as reading all the indices and vertices of its mesh,
+		// GPU culled instances are counted before culling
+		stats.vertexFetchBytes = stats.vertexFetchBytesFull = 0;
+		auto addFetch = [this](uint32_t indexCount, uint32_t vertexCount, VkIndexType indexType, size_t instances){
+			size_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+			stats.vertexFetchBytes += instances * (indexCount * indexSize + vertexCount * vertexLayout.stride());
+			stats.vertexFetchBytesFull += instances * (indexCount * sizeof(uint32_t) + vertexCount * FULL_VERTEX_SIZE);
+		};
+		for(size_t m = 0; m < models.size(); m++){
+			Model const& model = models[m];
+			size_t instances = cpuVisible.count[m];
+			if(cullingMode != CM_CPU){
+				instances = 0;
+				for(auto& tier: model.tiers)
+					instances += tier.instances.size();
+			}
+			addFetch(model.model.indexCount, model.model.vertexCount, modelResources.indexType, instances);
+		}
+		for(auto& mesh: staticMeshes)
+			if(mesh.visible)
+				addFetch(mesh.indexCount, mesh.vertexCount, mesh.indexType, 1);
 	}
+
+	// Everything written here belongs to the acquired image: prepareFrame has waited
+	// for the frame that rendered into it last, the other frames keep running
 	void draw()
 	{
+		VulkanExampleBase::prepareFrame();
+		uint32_t frame = currentBuffer;
+
+		// Frames that could use retired buffers are done, finished uploads are swapped in
+		frameCounter++;
+		destroyRetiredBuffers();
+		uploader.poll();
+
+		memcpy(uniformBuffers.scene.mapped(frame), &uboVS, sizeof(uboVS));
+
+		updateInstanceBuffers(frame);
+
+		cullScene(frame);
+
+		reserveIndirectDraws();
+		updateIndirectDraws(frame);
+
+		if(settings.overlay)
+			UIOverlay.update(frame);
 
 		if(shouldRecreateInstances){
-			updateInstanceBuffers();
+			if(cullingMode == CM_GPU && gpuCulling.outdated)
+				updateGpuCulling();
 			buildCommandBuffers();
 			shouldRecreateInstances = false;
 		}
 
+		buildFrameCommandBuffer(frame);
 
-		updateInstanceBuffers();
-
-		VulkanExampleBase::prepareFrame();
+		auto now = std::chrono::steady_clock::now();
+		if(now - recordCounter.start >= std::chrono::seconds(1)){
+			stats.sceneRecordsPerSecond = recordCounter.scene;
+			recordCounter.scene = 0;
+			recordCounter.start = now;
+			updateMemoryStats();
+		}
 
 		// Command buffer to be sumitted to the queue
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		submitInfo.pCommandBuffers = &drawCmdBuffers[frame];
 
-		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Submit to queue, the fence tells when the image and the frame slot are free again
+		VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentFrame]));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
 
 		VulkanExampleBase::submitFrame();
 	}
 
+	// Instance data is copied into the region of each image when that image is drawn
 	void moveModels(){
 		for(auto& model: models){
-			for(auto& instance: model.instances)
-				instance.pos += glm::vec3{1.0f, 0.0f, 0.0f};
+			for(auto& tier: model.tiers){
+				for(auto& instance: tier.instances)
+					instance.pos += glm::vec3{1.0f, 0.0f, 0.0f};
+				tier.instances.markAllDirty();
+			}
+		}
+	}
+
+	// Swap chain recreation may change the number of images, the device is idle at this point
+	virtual void windowResized()
+	{
+		if(drawCmdBuffers.size() == frameCount)
+			return;
+		frameCount = static_cast<uint32_t>(drawCmdBuffers.size());
+
+		prepareFrameResources();
+		prepareUniformBuffers();
+		updateDescriptorSets();
+		if(gpuCulling.supported){
+			prepareGpuCullingBuffers();
+			destroyFrameRing(gpuCulling.visible);
+			gpuCulling.visibleCapacity = 0;
+			gpuCulling.outdated = true;
+		}
+		shouldRecreateInstances = true;
+	}
+
+	// Sizes the per image state to frameCount
+	void prepareFrameResources()
+	{
+		if(!overlayCmdBuffers.empty())
+			vkFreeCommandBuffers(device, cmdPool, static_cast<uint32_t>(overlayCmdBuffers.size()), overlayCmdBuffers.data());
+		overlayCmdBuffers.resize(frameCount);
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, frameCount);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, overlayCmdBuffers.data()));
+
+		// Scene command buffers are allocated from the worker pools as the groups appear
+		sceneCommands.resize(frameCount);
+		if(workerCmdPools.empty())
+			setRecordingThreads(std::min(std::max(std::thread::hardware_concurrency(), 2u) - 1, 8u));
+		buildCommandBuffers();
+
+		destroyFrameRing(indirectDraws.commands);
+		indirectDraws.capacity = 0;
+
+		destroyFrameRing(cpuVisible.buffer);
+		cpuVisible.capacity = 0;
+
+		for(auto& model: models){
+			// Dynamic regions are reallocated for the current number of images
+			InstanceTier& dynamicTier = model.tiers[IT_DYNAMIC];
+			size_t count = std::max(dynamicTier.capacity, dynamicTier.instances.size());
+			dynamicTier.capacity = 0;
+			reserveInstanceBuffer(dynamicTier, IT_DYNAMIC, std::max(count, InstanceStorage::MIN_CAPACITY));
 		}
-		updateInstanceBuffers();
 	}
 
 	template<typename PairIt>
 	void prepare(PairIt begin, PairIt end)
 	{
 		std::cout << "Preparing Vulkan" << std::endl;
+		auto prepareStart = std::chrono::steady_clock::now();
 		VulkanExampleBase::prepare();
+		frameCount = static_cast<uint32_t>(drawCmdBuffers.size());
+		uploader.init(vulkanDevice, transferQueue, vulkanDevice->queueFamilyIndices.transfer, vulkanDevice->queueFamilyIndices.graphics);
+		std::cout << "Uploads use " << (uploader.transfersOwnership() ? "a transfer queue of their own" : "the graphics queue family") << std::endl;
 		std::cout << "Vk base prepared" << std::endl;
 		loadAssets(begin, end);
 		std::cout << "Assets loaded" << std::endl;
@@ -592,82 +1852,190 @@ public:
 		std::cout << "Uniform buffers prepared" << std::endl;
 		setupDescriptorSetLayout();
 		std::cout << "DescriptoLayout prepared" << std::endl;
+		auto pipelinesStart = std::chrono::steady_clock::now();
 		preparePipelines();
+		std::chrono::duration<float, std::milli> pipelinesTime = std::chrono::steady_clock::now() - pipelinesStart;
 		std::cout << "Pipelines prepared" << std::endl;
 		setupDescriptorPool();
 		std::cout << "Descriptor pool prepared" << std::endl;
 		setupDescriptorSet();
 		std::cout << "Desctiptor set prepared" << std::endl;
+		pipelinesStart = std::chrono::steady_clock::now();
+		prepareGpuCulling();
+		pipelinesTime += std::chrono::steady_clock::now() - pipelinesStart;
+		std::cout << "GPU culling prepared" << std::endl;
 		buildCommandBuffers();
 		std::cout << "Command Buffer prepared" << std::endl;
+		auto waitStart = std::chrono::steady_clock::now();
+		uploader.wait(assetUpload);
+		std::chrono::duration<float, std::milli> waitTime = std::chrono::steady_clock::now() - waitStart;
+		std::cout << "Asset upload finished behind the pipelines, waited " << waitTime.count() << " ms for it" << std::endl;
 		prepared = true;
+
+		std::chrono::duration<float, std::milli> prepareTime = std::chrono::steady_clock::now() - prepareStart;
+		stats.prepareMilliseconds = prepareTime.count();
+		stats.pipelineMilliseconds = pipelinesTime.count();
+		std::cout << "Prepared in " << stats.prepareMilliseconds << " ms, pipelines took " << stats.pipelineMilliseconds << " ms ("
+			<< pipelines.size() << " graphics pipelines for " << models.size() << " models, "
+			<< (pipelineCacheLoadedSize ? "warm pipeline cache of " + std::to_string(pipelineCacheLoadedSize) + " bytes" : std::string("cold pipeline cache")) << ")" << std::endl;
+		updateMemoryStats();
+		std::cout << "Buffer memory: " << stats.memoryAllocations << " buffers in " << stats.memoryBlocks << " blocks, "
+			<< stats.memoryUsedKB << " of " << stats.memoryReservedKB << " KB in use, " << stats.deviceAllocations << " device allocations" << std::endl;
 	}
 
 
-	InstanceView const* addInstance(int model_id){
+	InstanceView addInstance(int model_id, InstanceTierType type = IT_DYNAMIC){
+		return addInstances(model_id, 1, type).front();
+	}
 
+	// Adds n instances of the model at once, so that both the instance array and
+	// the GPU buffer grow (at most) once per call
+	std::vector<InstanceView> addInstances(int model_id, size_t n, InstanceTierType type = IT_DYNAMIC){
+		std::vector<InstanceView> ret;
+		if(n == 0)
+			return ret;
+		ret.reserve(n);
 
-		Model& model = models[model_id];
-		model.instances.emplace_back();
-		model.instanceViews.emplace_back(&(*(model.instances.end() - 1)));
-		
-		auto view_it = model.instanceViews.begin();
-		auto inst_it = model.instances.begin();
-		auto view_end = model.instanceViews.end();
-		
-		for(; view_it != view_end; view_it++, inst_it++)
-			(*view_it).reset(&(*inst_it));
+		InstanceTier& tier = models[model_id].tiers[type];
+		tier.instances.reserve(tier.instances.size() + n);
+		for(size_t i = 0; i < n; i++)
+			ret.push_back(tier.instances.add());
 
-		model.instanceBuf.destroy();
+		// Draw counts come from indirect commands, so only a new buffer needs recording
+		reserveInstanceBuffer(tier, type, tier.instances.capacity());
 
-		model.instanceBuf.size = model.instances.size() * sizeof(InstanceData);
+		return ret;
+	}
 
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&model.instanceBuf,
-			model.instances.size() * sizeof(InstanceData),
-			model.instances.data()));
+	// Returns the id of a new empty static mesh drawn with the model
+	size_t addStaticMesh(int model_id){
+		size_t id;
+		if(freeStaticMeshes.empty()){
+			id = staticMeshes.size();
+			staticMeshes.emplace_back();
+		}
+		else{
+			id = freeStaticMeshes.back();
+			freeStaticMeshes.pop_back();
+		}
+		staticMeshes[id].model = model_id;
+		return id;
+	}
+
+	void returnStaticMesh(size_t id){
+		if(id >= staticMeshes.size() || staticMeshes[id].model < 0)
+			return;
 
-		VK_CHECK_RESULT(model.instanceBuf.map());
+		StaticMesh& mesh = staticMeshes[id];
+		stats.staticMeshTriangles -= mesh.indexCount / 3;
+		retireBuffer(mesh.vertices);
+		retireBuffer(mesh.indices);
+		// An upload still on its way is dropped with pendingUpload
+		mesh = StaticMesh{};
+		freeStaticMeshes.push_back(id);
 
 		shouldRecreateInstances = true;
+	}
 
+	// Geometry of a static mesh on its way to the device
+	struct PendingMesh{
+		size_t id;
+		StaticMesh mesh;
+	};
 
-		return &(*(--model.instanceViews.end()));
-	}
+	// Replaces the geometry of the static meshes. All the meshes are uploaded into new device
+	// local buffers with one submit on the transfer queue, the meshes keep drawing their old
+	// geometry until the upload has finished, then the new buffers are swapped in
+	void updateStaticMeshes(std::vector<std::pair<size_t, MeshData>> const& updates){
+		if(updates.empty())
+			return;
 
-	void returnInstance(InstanceView const* instance){
-		for(auto& model: models){
-			bool flag = false;
-			auto view_it = model.instanceViews.begin();
-			auto inst_it = model.instances.begin();
-			while( inst_it != model.instances.end()){
-				if(!flag){
-					if(&(*view_it) == instance){
-						view_it = model.instanceViews.erase(view_it);
-						inst_it = model.instances.erase(inst_it);
-						flag = true;
-						continue;
-					}
-					else{
-						++view_it;
-						++inst_it;
-					}
-				}
-				else{
-					(*view_it).reset(&(*inst_it));
-						++view_it;
-						++inst_it;					
-				}
+		vks::UploadBatch batch(vulkanDevice);
+		vks::AsyncUploader::Ticket ticket = uploader.nextTicket();
+
+		// Vertices are packed into vertexLayout, indices are 16 bit whenever the mesh allows it.
+		// The batch only reads them when it is submitted
+		std::vector<std::vector<uint8_t>> packedVertices(updates.size());
+		std::vector<std::vector<uint16_t>> shortIndices(updates.size());
+		std::vector<PendingMesh> pending(updates.size());
+
+		auto createBuffer = [&](void const* data, VkDeviceSize size, VkBufferUsageFlags usage, vks::Buffer& buffer){
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(
+				usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&buffer,
+				size));
+			batch.addBuffer(data, size, buffer.buffer);
+		};
+
+		for(size_t u = 0; u < updates.size(); u++){
+			MeshData const& data = updates[u].second;
+			PendingMesh& update = pending[u];
+			update.id = updates[u].first;
+			staticMeshes[update.id].pendingUpload = ticket;
+
+			StaticMesh& mesh = update.mesh;
+			if(data.indices.empty())
+				continue;
+
+			packedVertices[u] = packVertices(data.vertices);
+			createBuffer(packedVertices[u].data(), packedVertices[u].size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh.vertices);
+			if(data.vertices.size() <= UINT16_MAX){
+				shortIndices[u].assign(data.indices.begin(), data.indices.end());
+				createBuffer(shortIndices[u].data(), shortIndices[u].size() * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh.indices);
+				mesh.indexType = VK_INDEX_TYPE_UINT16;
+			}
+			else{
+				createBuffer(data.indices.data(), data.indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh.indices);
+				mesh.indexType = VK_INDEX_TYPE_UINT32;
 			}
+			mesh.indexCount = static_cast<uint32_t>(data.indices.size());
+			mesh.vertexCount = static_cast<uint32_t>(data.vertices.size());
 
+			glm::vec3 min = data.vertices.front().position, max = min;
+			for(auto& vertex: data.vertices){
+				min = glm::min(min, vertex.position);
+				max = glm::max(max, vertex.position);
+			}
+			mesh.center = (min + max) * 0.5f;
+			mesh.radius = glm::length(max - min) * 0.5f;
+		}
 
+		stats.asyncUploadBytes += batch.size();
+		uploader.submit(batch, [this, ticket, pending]() mutable {
+			swapStaticMeshes(ticket, pending);
+		});
+	}
+
+	// Replaces the meshes by their uploaded geometry, unless they were updated again or returned since
+	void swapStaticMeshes(vks::AsyncUploader::Ticket ticket, std::vector<PendingMesh>& pending){
+		for(auto& update: pending){
+			StaticMesh& mesh = staticMeshes[update.id];
+			if(mesh.pendingUpload != ticket){
+				retireBuffer(update.mesh.vertices);
+				retireBuffer(update.mesh.indices);
+				continue;
+			}
+
+			stats.staticMeshTriangles -= mesh.indexCount / 3;
+			retireBuffer(mesh.vertices);
+			retireBuffer(mesh.indices);
+			update.mesh.model = mesh.model;
+			mesh = update.mesh;
+			stats.staticMeshTriangles += mesh.indexCount / 3;
 		}
 
 		shouldRecreateInstances = true;
 	}
 
+	// Views know their model, so returning is O(1): the last instance of the model is moved into the hole
+	void returnInstance(InstanceView const& instance){
+		if(!instance.valid())
+			return;
+
+		instance.storage()->remove(instance);
+	}
+
 	virtual void render()
 	{
 		if (!prepared)
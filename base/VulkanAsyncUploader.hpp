@@ -0,0 +1,237 @@
+/*
+* Asynchronous uploads on a transfer queue
+*
+* Submits upload batches to a (preferably dedicated) transfer queue without
+* waiting for them. Each submission has a fence that is polled once per
+* frame; finished submissions free their staging memory and queue the
+* acquire barriers of the queue family ownership transfer, which the
+* graphics queue records before it uses the uploaded resources. The host
+* observing the fence before the acquire is submitted orders the release
+* before the acquire, no semaphore is needed.
+*
+* This code is licensed under the MIT license(MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
+
+namespace vks
+{
+	class AsyncUploader
+	{
+	public:
+		/** @brief Identifies a submission, tickets grow with every submit() */
+		typedef uint64_t Ticket;
+
+		struct Stats
+		{
+			uint64_t submissions = 0;
+			uint64_t bytes = 0;
+			/** @brief Submissions not finished yet */
+			uint32_t inFlight = 0;
+			/** @brief Time the host spent blocked in wait() */
+			float waitMilliseconds = 0.0f;
+		};
+
+	private:
+		struct Submission
+		{
+			Ticket ticket;
+			VkCommandBuffer cmd;
+			VkFence fence;
+			vks::Buffer staging;
+			vks::UploadBatch::OwnershipTransfer transfer;
+			std::function<void()> onComplete;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t srcQueueFamily = 0;
+		uint32_t dstQueueFamily = 0;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::deque<Submission> inFlight;
+		std::vector<VkBufferMemoryBarrier> bufferAcquires;
+		std::vector<VkImageMemoryBarrier> imageAcquires;
+		bool memoryAcquire = false;
+		Ticket lastTicket = 0;
+		Ticket finishedTicket = 0;
+		Stats counters;
+
+		void finishFront()
+		{
+			Submission& submission = inFlight.front();
+			bufferAcquires.insert(bufferAcquires.end(), submission.transfer.bufferAcquires.begin(), submission.transfer.bufferAcquires.end());
+			imageAcquires.insert(imageAcquires.end(), submission.transfer.imageAcquires.begin(), submission.transfer.imageAcquires.end());
+			memoryAcquire = true;
+
+			vkDestroyFence(device->logicalDevice, submission.fence, nullptr);
+			vkFreeCommandBuffers(device->logicalDevice, commandPool, 1, &submission.cmd);
+			submission.staging.destroy();
+			finishedTicket = submission.ticket;
+
+			std::function<void()> onComplete = std::move(submission.onComplete);
+			inFlight.pop_front();
+			if (onComplete)
+				onComplete();
+		}
+
+	public:
+		~AsyncUploader()
+		{
+			destroy();
+		}
+
+		/**
+		* @param device Device the resources are created on
+		* @param queue Queue the copies are submitted to, the graphics queue itself if there is no other
+		* @param queueFamily Family of that queue
+		* @param dstQueueFamily Family of the queue that uses the uploaded resources
+		*/
+		void init(vks::VulkanDevice* device, VkQueue queue, uint32_t queueFamily, uint32_t dstQueueFamily)
+		{
+			this->device = device;
+			this->queue = queue;
+			srcQueueFamily = queueFamily;
+			this->dstQueueFamily = dstQueueFamily;
+			commandPool = device->createCommandPool(queueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		}
+
+		/** @brief Waits for all submissions and frees the command pool */
+		void destroy()
+		{
+			if (commandPool == VK_NULL_HANDLE)
+				return;
+			wait(lastTicket);
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			commandPool = VK_NULL_HANDLE;
+		}
+
+		/** @brief True if the copies run on a queue family of their own and resources change their owner */
+		bool transfersOwnership() const
+		{
+			return srcQueueFamily != dstQueueFamily;
+		}
+
+		/**
+		* Stages the batch and submits its copies without waiting for them, the batch is empty afterwards
+		*
+		* @param batch Copies to submit, their data may be released as soon as this returns
+		* @param onComplete (Optional) Called by poll() or wait() once the copies have finished, before the resources are acquired
+		*
+		* @return Ticket of the submission, 0 if the batch was empty
+		*/
+		Ticket submit(vks::UploadBatch& batch, std::function<void()> onComplete = nullptr)
+		{
+			if (batch.count() == 0)
+			{
+				if (onComplete)
+					onComplete();
+				return 0;
+			}
+
+			inFlight.emplace_back();
+			Submission& submission = inFlight.back();
+			submission.ticket = ++lastTicket;
+			submission.onComplete = std::move(onComplete);
+			submission.transfer.srcQueueFamily = srcQueueFamily;
+			submission.transfer.dstQueueFamily = dstQueueFamily;
+
+			counters.submissions++;
+			counters.bytes += batch.size();
+			batch.stage(submission.staging);
+
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &submission.cmd));
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(submission.cmd, &cmdBufInfo));
+			batch.record(submission.cmd, submission.staging, &submission.transfer);
+			VK_CHECK_RESULT(vkEndCommandBuffer(submission.cmd));
+			batch.clear();
+
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(0);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &submission.fence));
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &submission.cmd;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, submission.fence));
+
+			return submission.ticket;
+		}
+
+		/** @brief Finishes the submissions whose fences have signaled, in submission order, without blocking */
+		void poll()
+		{
+			while (!inFlight.empty() && vkGetFenceStatus(device->logicalDevice, inFlight.front().fence) == VK_SUCCESS)
+				finishFront();
+		}
+
+		/** @brief Blocks until the submission of the ticket and all before it have finished */
+		void wait(Ticket ticket)
+		{
+			auto start = std::chrono::steady_clock::now();
+			while (!inFlight.empty() && inFlight.front().ticket <= ticket)
+			{
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &inFlight.front().fence, VK_TRUE, UINT64_MAX));
+				finishFront();
+			}
+			counters.waitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		/** @brief Ticket the next submit() will return if its batch isn't empty */
+		Ticket nextTicket() const
+		{
+			return lastTicket + 1;
+		}
+
+		bool finished(Ticket ticket) const
+		{
+			return ticket <= finishedTicket;
+		}
+
+		/**
+		* Records the acquire barriers of the finished submissions, the resources may be used by the commands that follow
+		*
+		* @param cmd Command buffer of the destination queue, outside of a render pass
+		*/
+		void recordAcquire(VkCommandBuffer cmd)
+		{
+			if (!memoryAcquire)
+				return;
+
+			// Without an ownership transfer the copies only have to be made visible
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+			vkCmdPipelineBarrier(
+				cmd,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				transfersOwnership() ? 0 : 1, &memoryBarrier,
+				static_cast<uint32_t>(bufferAcquires.size()), bufferAcquires.data(),
+				static_cast<uint32_t>(imageAcquires.size()), imageAcquires.data());
+
+			bufferAcquires.clear();
+			imageAcquires.clear();
+			memoryAcquire = false;
+		}
+
+		Stats stats() const
+		{
+			Stats stats = counters;
+			stats.inFlight = static_cast<uint32_t>(inFlight.size());
+			return stats;
+		}
+	};
+}
@@ -14,6 +14,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "VulkanMemoryAllocator.hpp"
 
 namespace vks
 {	
@@ -31,6 +32,11 @@ namespace vks
 		VkDeviceSize alignment = 0;
 		void* mapped = nullptr;
 
+		/** @brief Allocator the memory was placed by, null if the buffer owns its memory */
+		vks::MemoryAllocator* allocator = nullptr;
+		/** @brief Range of the memory the buffer is bound to, memory may be shared with other buffers */
+		vks::MemoryAllocator::Allocation allocation;
+
 		/** @brief Usage flags to be filled by external source at buffer creation (to query at some later point) */
 		VkBufferUsageFlags usageFlags;
 		/** @brief Memory propertys flags to be filled by external source at buffer creation (to query at some later point) */
@@ -46,7 +52,13 @@ namespace vks
 		*/
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			return vkMapMemory(device, memory, offset, size, 0, &mapped);
+			// Pooled host visible memory stays mapped by the allocator
+			if (allocation.mapped)
+			{
+				mapped = static_cast<char*>(allocation.mapped) + offset;
+				return VK_SUCCESS;
+			}
+			return vkMapMemory(device, memory, allocation.offset + offset, size, 0, &mapped);
 		}
 
 		/**
@@ -58,7 +70,8 @@ namespace vks
 		{
 			if (mapped)
 			{
-				vkUnmapMemory(device, memory);
+				if (!allocation.mapped)
+					vkUnmapMemory(device, memory);
 				mapped = nullptr;
 			}
 		}
@@ -72,7 +85,7 @@ namespace vks
 		*/
 		VkResult bind(VkDeviceSize offset = 0)
 		{
-			return vkBindBufferMemory(device, buffer, memory, offset);
+			return vkBindBufferMemory(device, buffer, memory, allocation.offset + offset);
 		}
 
 		/**
@@ -117,8 +130,8 @@ namespace vks
 			VkMappedMemoryRange mappedRange = {};
 			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			mappedRange.offset = allocation.offset + offset;
+			mappedRange.size = allocator && size == VK_WHOLE_SIZE ? allocation.size - offset : size;
 			return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -137,8 +150,8 @@ namespace vks
 			VkMappedMemoryRange mappedRange = {};
 			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			mappedRange.offset = allocation.offset + offset;
+			mappedRange.size = allocator && size == VK_WHOLE_SIZE ? allocation.size - offset : size;
 			return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -151,7 +164,15 @@ namespace vks
 			{
 				vkDestroyBuffer(device, buffer, nullptr);
 			}
-			if (memory)
+			if (allocator)
+			{
+				// The pool may hand the range out again, so the buffer must not free it twice
+				unmap();
+				allocator->free(allocation);
+				allocator = nullptr;
+				memory = VK_NULL_HANDLE;
+			}
+			else if (memory)
 			{
 				vkFreeMemory(device, memory, nullptr);
 			}
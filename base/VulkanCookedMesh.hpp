@@ -0,0 +1,427 @@
+/*
+* Cooked meshes: models converted offline into the exact vertex and index
+* layout they are drawn with, loaded by mapping the file into memory and
+* copying it straight into staging buffers
+*
+* File layout (all offsets are in bytes from the start of the file):
+*	Header
+*	Model::ModelPart[partCount]	at partsOffset
+*	vertices					at verticesOffset, verticesSize bytes
+*	indices						at indicesOffset, indicesSize bytes (16 or 32 bit as indexType says)
+*
+* A cooked file is only used while it matches the version, the vertex layout
+* and the load time settings of the loader, and the size and modification
+* time of the source file it was cooked from. Otherwise it is stale and the
+* model is imported with ASSIMP as before.
+*
+* This code is licensed under the MIT license(MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "VulkanModel.hpp"
+
+namespace vks
+{
+	namespace cooked
+	{
+		const uint32_t MAGIC = 0x4853454D; // "MESH"
+		// Bump whenever the file layout or the conversion done by Model::importFromFile changes
+		const uint32_t VERSION = 1;
+		const uint32_t MAX_COMPONENTS = 16;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t componentCount;
+			uint32_t components[MAX_COMPONENTS];
+			float scale[3];
+			float uvscale[2];
+			float center[3];
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t indexType;
+			uint32_t partCount;
+			float dimMin[3];
+			float dimMax[3];
+			uint64_t partsOffset;
+			uint64_t verticesOffset;
+			uint64_t verticesSize;
+			uint64_t indicesOffset;
+			uint64_t indicesSize;
+		};
+
+		/** @brief Size and modification time of a source file, both zero if it does not exist */
+		struct SourceStamp
+		{
+			uint64_t size = 0;
+			int64_t time = 0;
+			bool exists = false;
+		};
+
+		inline SourceStamp stamp(const std::string& filename)
+		{
+			SourceStamp res;
+			std::error_code error;
+			uint64_t size = std::filesystem::file_size(filename, error);
+			if (error)
+				return res;
+			auto time = std::filesystem::last_write_time(filename, error);
+			if (error)
+				return res;
+			res.size = size;
+			res.time = static_cast<int64_t>(time.time_since_epoch().count());
+			res.exists = true;
+			return res;
+		}
+
+		inline uint64_t alignOffset(uint64_t offset)
+		{
+			return (offset + 15) & ~uint64_t(15);
+		}
+
+		inline void fillSettings(Header& header, const vks::VertexLayout& layout, const vks::ModelCreateInfo& createInfo)
+		{
+			header.componentCount = static_cast<uint32_t>(layout.components.size());
+			for (size_t i = 0; i < layout.components.size() && i < MAX_COMPONENTS; i++)
+				header.components[i] = static_cast<uint32_t>(layout.components[i]);
+			memcpy(header.scale, &createInfo.scale, sizeof(header.scale));
+			memcpy(header.uvscale, &createInfo.uvscale, sizeof(header.uvscale));
+			memcpy(header.center, &createInfo.center, sizeof(header.center));
+		}
+
+		/**
+		* Writes a model converted by Model::importFromFile into a cooked file
+		*
+		* @param filename Cooked file to write
+		* @param data Converted vertices, indices and parts
+		* @param layout Vertex layout the data was converted into
+		* @param createInfo Load time settings the data was converted with
+		* @param source Stamp of the file the data was imported from
+		*/
+		inline bool write(const std::string& filename, const vks::Model::Data& data, const vks::VertexLayout& layout, const vks::ModelCreateInfo& createInfo, const SourceStamp& source)
+		{
+			if (layout.components.size() > MAX_COMPONENTS)
+				return false;
+
+			Header header{};
+			header.magic = MAGIC;
+			header.version = VERSION;
+			fillSettings(header, layout, createInfo);
+			header.sourceSize = source.size;
+			header.sourceTime = source.time;
+			header.vertexCount = data.vertexCount;
+			header.indexCount = data.indexCount;
+			header.indexType = static_cast<uint32_t>(data.indexType);
+			header.partCount = static_cast<uint32_t>(data.parts.size());
+			memcpy(header.dimMin, &data.dim.min, sizeof(header.dimMin));
+			memcpy(header.dimMax, &data.dim.max, sizeof(header.dimMax));
+
+			header.partsOffset = alignOffset(sizeof(Header));
+			header.verticesOffset = alignOffset(header.partsOffset + data.parts.size() * sizeof(vks::Model::ModelPart));
+			header.verticesSize = data.vertices.size();
+			header.indicesOffset = alignOffset(header.verticesOffset + header.verticesSize);
+			header.indicesSize = data.indices.size();
+
+			std::vector<uint8_t> file(header.indicesOffset + header.indicesSize, 0);
+			memcpy(file.data(), &header, sizeof(header));
+			if (!data.parts.empty())
+				memcpy(file.data() + header.partsOffset, data.parts.data(), data.parts.size() * sizeof(vks::Model::ModelPart));
+			if (!data.vertices.empty())
+				memcpy(file.data() + header.verticesOffset, data.vertices.data(), data.vertices.size());
+			if (!data.indices.empty())
+				memcpy(file.data() + header.indicesOffset, data.indices.data(), data.indices.size());
+
+			// Written next to the target first, so that a failed cook never leaves a truncated file behind
+			std::string temp = filename + ".tmp";
+			{
+				std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+				if (!out.is_open())
+					return false;
+				out.write(reinterpret_cast<const char*>(file.data()), file.size());
+				if (!out.good())
+					return false;
+			}
+			std::error_code error;
+			std::filesystem::rename(temp, filename, error);
+			return !error;
+		}
+
+		/** @brief Read-only memory mapping of a whole file */
+		class MappedFile
+		{
+			const uint8_t* data_ = nullptr;
+			size_t size_ = 0;
+#if defined(_WIN32)
+			HANDLE file_ = INVALID_HANDLE_VALUE;
+			HANDLE mapping_ = nullptr;
+#endif
+		public:
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			~MappedFile()
+			{
+				close();
+			}
+
+			bool open(const std::string& filename)
+			{
+				close();
+#if defined(_WIN32)
+				file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+				if (file_ == INVALID_HANDLE_VALUE)
+					return false;
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+				{
+					close();
+					return false;
+				}
+				mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (!mapping_)
+				{
+					close();
+					return false;
+				}
+				data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+				if (!data_)
+				{
+					close();
+					return false;
+				}
+				size_ = static_cast<size_t>(size.QuadPart);
+#else
+				int fd = ::open(filename.c_str(), O_RDONLY);
+				if (fd < 0)
+					return false;
+				struct stat info;
+				if (fstat(fd, &info) != 0 || info.st_size == 0)
+				{
+					::close(fd);
+					return false;
+				}
+				void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				// The mapping keeps the file alive on its own
+				::close(fd);
+				if (mapped == MAP_FAILED)
+					return false;
+				data_ = static_cast<const uint8_t*>(mapped);
+				size_ = static_cast<size_t>(info.st_size);
+#endif
+				return true;
+			}
+
+			void close()
+			{
+#if defined(_WIN32)
+				if (data_)
+					UnmapViewOfFile(data_);
+				if (mapping_)
+					CloseHandle(mapping_);
+				if (file_ != INVALID_HANDLE_VALUE)
+					CloseHandle(file_);
+				mapping_ = nullptr;
+				file_ = INVALID_HANDLE_VALUE;
+#else
+				if (data_)
+					munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+				data_ = nullptr;
+				size_ = 0;
+			}
+
+			const uint8_t* data() const
+			{
+				return data_;
+			}
+
+			size_t size() const
+			{
+				return size_;
+			}
+		};
+
+		/**
+		* Checks that a mapped file is a cooked mesh that is not stale
+		*
+		* @param file Mapped cooked file
+		* @param layout Vertex layout the model is loaded with
+		* @param createInfo Load time settings the model is loaded with
+		* @param source Stamp of the source file, a missing source never makes the cooked file stale
+		* @param reason Receives why the file can not be used
+		* @return Header of the file, nullptr if it can not be used
+		*/
+		inline const Header* validate(const MappedFile& file, const vks::VertexLayout& layout, const vks::ModelCreateInfo& createInfo, const SourceStamp& source, std::string& reason)
+		{
+			if (file.size() < sizeof(Header))
+			{
+				reason = "no cooked file";
+				return nullptr;
+			}
+
+			const Header* header = reinterpret_cast<const Header*>(file.data());
+			if (header->magic != MAGIC || header->version != VERSION)
+			{
+				reason = "cooked with another version";
+				return nullptr;
+			}
+
+			Header expected{};
+			fillSettings(expected, layout, createInfo);
+			if (header->componentCount != expected.componentCount
+				|| memcmp(header->components, expected.components, sizeof(expected.components)) != 0
+				|| memcmp(header->scale, expected.scale, sizeof(expected.scale)) != 0
+				|| memcmp(header->uvscale, expected.uvscale, sizeof(expected.uvscale)) != 0
+				|| memcmp(header->center, expected.center, sizeof(expected.center)) != 0)
+			{
+				reason = "cooked with another vertex layout or scale";
+				return nullptr;
+			}
+
+			if (source.exists && (header->sourceSize != source.size || header->sourceTime != source.time))
+			{
+				reason = "source changed since it was cooked";
+				return nullptr;
+			}
+
+			uint64_t partsSize = uint64_t(header->partCount) * sizeof(vks::Model::ModelPart);
+			uint32_t indexSize = header->indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+			if (header->partsOffset + partsSize > file.size()
+				|| header->verticesOffset + header->verticesSize > file.size()
+				|| header->indicesOffset + header->indicesSize > file.size()
+				|| header->verticesSize != uint64_t(header->vertexCount) * vks::VertexLayout(layout).stride()
+				|| header->indicesSize != uint64_t(header->indexCount) * indexSize)
+			{
+				reason = "cooked file is truncated";
+				return nullptr;
+			}
+
+			return header;
+		}
+
+		/** @brief Cooked mesh mapped into memory, ready to be uploaded */
+		class Mesh
+		{
+			MappedFile file;
+			const Header* header = nullptr;
+		public:
+			/**
+			* Maps a cooked file and checks that it is not stale
+			*
+			* @param filename Cooked file
+			* @param sourceFilename File the model was cooked from
+			* @param layout Vertex layout components the model is loaded with
+			* @param createInfo Load time settings the model is loaded with
+			* @param reason Receives why the cooked file can not be used
+			* @return False if the cooked file is missing or stale
+			*/
+			bool open(const std::string& filename, const std::string& sourceFilename, const vks::VertexLayout& layout, const vks::ModelCreateInfo& createInfo, std::string& reason)
+			{
+				header = nullptr;
+				if (!file.open(filename))
+				{
+					reason = "no cooked file";
+					return false;
+				}
+				header = validate(file, layout, createInfo, stamp(sourceFilename), reason);
+				if (!header)
+					file.close();
+				return header != nullptr;
+			}
+
+			bool valid() const
+			{
+				return header != nullptr;
+			}
+
+			/** @brief Takes over the counts, parts and dimensions of the mesh, the model gets no buffers */
+			void describe(vks::Model& model) const
+			{
+				model.vertexCount = header->vertexCount;
+				model.indexCount = header->indexCount;
+				model.indexType = static_cast<VkIndexType>(header->indexType);
+				model.parts.resize(header->partCount);
+				if (header->partCount)
+					memcpy(model.parts.data(), file.data() + header->partsOffset, header->partCount * sizeof(vks::Model::ModelPart));
+				memcpy(&model.dim.min, header->dimMin, sizeof(header->dimMin));
+				memcpy(&model.dim.max, header->dimMax, sizeof(header->dimMax));
+				model.dim.size = model.dim.max - model.dim.min;
+			}
+
+			const uint8_t* vertices() const
+			{
+				return file.data() + header->verticesOffset;
+			}
+
+			VkDeviceSize verticesSize() const
+			{
+				return header->verticesSize;
+			}
+
+			const uint8_t* indices() const
+			{
+				return file.data() + header->indicesOffset;
+			}
+
+			VkDeviceSize indicesSize() const
+			{
+				return header->indicesSize;
+			}
+
+			/**
+			* Sets up the model from the mapped file and adds its copies to a batch, the file stays mapped until this mesh is destroyed
+			*/
+			void upload(vks::Model& model, vks::ModelCreateInfo& createInfo, vks::VulkanDevice* device, vks::UploadBatch& batch) const
+			{
+				describe(model);
+				model.upload(vertices(), verticesSize(), indices(), indicesSize(), &createInfo, device, batch);
+			}
+		};
+
+		/**
+		* Loads a cooked model into Vulkan buffers
+		*
+		* @param model Model to load into
+		* @param filename Cooked file
+		* @param sourceFilename File the model was cooked from
+		* @param layout Vertex layout components the model is loaded with
+		* @param createInfo Load time settings the model is loaded with
+		* @param device Pointer to the Vulkan device used to generated the vertex and index buffers on
+		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
+		* @param reason Receives why the cooked file can not be used
+		* @return False if the cooked file is missing or stale, the model is left untouched then
+		*/
+		inline bool load(vks::Model& model, const std::string& filename, const std::string& sourceFilename, const vks::VertexLayout& layout, vks::ModelCreateInfo& createInfo, vks::VulkanDevice* device, VkQueue copyQueue, std::string& reason)
+		{
+			Mesh mesh;
+			if (!mesh.open(filename, sourceFilename, layout, createInfo, reason))
+				return false;
+
+			vks::UploadBatch batch(device);
+			mesh.upload(model, createInfo, device, batch);
+			batch.submit(copyQueue);
+			return true;
+		}
+	}
+}
@@ -44,6 +44,11 @@ namespace vks
 		/** @brief Set to true when the debug marker extension is detected */
 		bool enableDebugMarkers = false;
 
+		/** @brief Pools the memory of buffers created with createBuffer(..., vks::Buffer*, ...) are placed in */
+		vks::MemoryAllocator memoryAllocator;
+		/** @brief Set to false to give every buffer memory of its own, as before the pools */
+		bool pooledBufferMemory = true;
+
 		/** @brief Contains queue family indices */
 		struct
 		{
@@ -102,6 +107,7 @@ namespace vks
 		*/
 		~VulkanDevice()
 		{
+			memoryAllocator.destroy();
 			if (commandPool)
 			{
 				vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
@@ -328,6 +334,7 @@ namespace vks
 			{
 				// Create a default command pool for graphics command buffers
 				commandPool = createCommandPool(queueFamilyIndices.graphics);
+				memoryAllocator.init(logicalDevice, memoryProperties, properties.limits);
 			}
 
 			this->enabledFeatures = enabledFeatures;
@@ -396,11 +403,16 @@ namespace vks
 		* @param size Size of the buffer in byes
 		* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
 		*
+		* @note The memory is placed in a pool of memoryAllocator, staging buffers (transfer source only) in a linear one
+		*
 		* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
 		*/
 		VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data = nullptr)
 		{
 			buffer->device = logicalDevice;
+			buffer->allocator = nullptr;
+			buffer->allocation = vks::MemoryAllocator::Allocation{};
+			buffer->mapped = nullptr;
 
 			// Create the buffer handle
 			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
@@ -408,15 +420,26 @@ namespace vks
 
 			// Create the memory backing up the buffer handle
 			VkMemoryRequirements memReqs;
-			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 			vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-			memAlloc.allocationSize = memReqs.size;
 			// Find a memory type index that fits the properties of the buffer
-			memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+			uint32_t memoryType = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+			if (pooledBufferMemory)
+			{
+				vks::MemoryAllocator::PoolType pool = usageFlags == VK_BUFFER_USAGE_TRANSFER_SRC_BIT ? vks::MemoryAllocator::POOL_LINEAR : vks::MemoryAllocator::POOL_FREE_LIST;
+				VK_CHECK_RESULT(memoryAllocator.allocate(memReqs, memoryType, pool, buffer->allocation));
+				buffer->allocator = &memoryAllocator;
+				buffer->memory = buffer->allocation.memory;
+			}
+			else
+			{
+				VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+				memAlloc.allocationSize = memReqs.size;
+				memAlloc.memoryTypeIndex = memoryType;
+				VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+			}
 
 			buffer->alignment = memReqs.alignment;
-			buffer->size = memAlloc.allocationSize;
+			buffer->size = memReqs.size;
 			buffer->usageFlags = usageFlags;
 			buffer->memoryPropertyFlags = memoryPropertyFlags;
 
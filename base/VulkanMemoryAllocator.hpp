@@ -0,0 +1,387 @@
+/*
+* Device memory sub-allocator
+*
+* Buffers are placed into large blocks of device memory instead of getting
+* a vkAllocateMemory each. Every memory type has two pools: a free-list pool
+* for buffers that live for a while (first fit, neighbouring free ranges are
+* merged) and a linear pool for short lived staging buffers (bump allocation,
+* a block is reset once all of its buffers are gone). Allocations too large
+* for a block get memory of their own.
+*
+* Host visible blocks are mapped once for their whole lifetime, as a memory
+* object can't be mapped by several buffers at the same time.
+*
+* This code is licensed under the MIT license(MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	class MemoryAllocator
+	{
+	public:
+		enum PoolType
+		{
+			POOL_FREE_LIST,
+			POOL_LINEAR,
+			POOL_COUNT,
+			POOL_DEDICATED = POOL_COUNT
+		};
+
+	private:
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			void* mapped = nullptr;
+			/** @brief Free ranges of a free-list block by their offset */
+			std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+			/** @brief First free byte of a linear block */
+			VkDeviceSize head = 0;
+			uint32_t allocations = 0;
+		};
+
+	public:
+		struct Allocation
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			uint32_t memoryType = 0;
+			PoolType pool = POOL_DEDICATED;
+			/** @brief Host address of offset if the block is persistently mapped */
+			void* mapped = nullptr;
+			Block* block = nullptr;
+		};
+
+		struct Stats
+		{
+			uint32_t blocks = 0;
+			uint32_t dedicatedAllocations = 0;
+			/** @brief Live allocations in the pools */
+			uint32_t allocations = 0;
+			/** @brief Device memory held by blocks and dedicated allocations */
+			VkDeviceSize reservedBytes = 0;
+			/** @brief Bytes of that memory occupied by allocations */
+			VkDeviceSize usedBytes = 0;
+			/** @brief Number of free ranges in the free-list pools */
+			uint32_t freeRanges = 0;
+			VkDeviceSize largestFreeRange = 0;
+			/** @brief Share of the free bytes of the free-list pools outside of the largest free range of their block, 0 if nothing is split */
+			float fragmentation = 0.0f;
+			/** @brief vkAllocateMemory calls so far */
+			uint32_t deviceAllocations = 0;
+		};
+
+		/** @brief Block size of memory types in heaps large enough, smaller heaps get an eighth of their size */
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		VkDeviceSize nonCoherentAtomSize = 1;
+		std::vector<VkDeviceSize> blockSizes;
+		std::vector<std::vector<std::unique_ptr<Block>>> pools; // memory type * POOL_COUNT + pool
+		uint32_t dedicatedAllocations = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		uint32_t deviceAllocations = 0;
+		mutable std::mutex mutex;
+
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		bool hostVisible(uint32_t memoryType) const
+		{
+			return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+		}
+
+		/** @brief Flushes and invalidations of non coherent memory cover whole atoms, so allocations must not share one */
+		VkDeviceSize atomSize(uint32_t memoryType) const
+		{
+			bool coherent = (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+			return hostVisible(memoryType) && !coherent ? nonCoherentAtomSize : 1;
+		}
+
+		VkResult allocateMemory(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory* memory)
+		{
+			VkMemoryAllocateInfo memAlloc{};
+			memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memAlloc.allocationSize = size;
+			memAlloc.memoryTypeIndex = memoryType;
+			VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, memory);
+			if (result == VK_SUCCESS)
+				deviceAllocations++;
+			return result;
+		}
+
+		Block* createBlock(uint32_t memoryType, PoolType pool)
+		{
+			std::unique_ptr<Block> block(new Block());
+			block->size = blockSizes[memoryType];
+			if (allocateMemory(block->size, memoryType, &block->memory) != VK_SUCCESS)
+				return nullptr;
+			if (hostVisible(memoryType))
+				VK_CHECK_RESULT(vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+			if (pool == POOL_FREE_LIST)
+				block->freeRanges[0] = block->size;
+			pools[memoryType * POOL_COUNT + pool].push_back(std::move(block));
+			return pools[memoryType * POOL_COUNT + pool].back().get();
+		}
+
+		void destroyBlock(Block* block)
+		{
+			if (block->mapped)
+				vkUnmapMemory(device, block->memory);
+			vkFreeMemory(device, block->memory, nullptr);
+		}
+
+		/** @brief First fit, the alignment padding in front of the allocation stays free */
+		static bool allocateFreeList(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+		{
+			for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range)
+			{
+				VkDeviceSize begin = range->first;
+				VkDeviceSize end = begin + range->second;
+				VkDeviceSize aligned = alignUp(begin, alignment);
+				if (aligned + size > end)
+					continue;
+
+				block.freeRanges.erase(range);
+				if (aligned > begin)
+					block.freeRanges[begin] = aligned - begin;
+				if (aligned + size < end)
+					block.freeRanges[aligned + size] = end - aligned - size;
+				offset = aligned;
+				return true;
+			}
+			return false;
+		}
+
+		static bool allocateLinear(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+		{
+			VkDeviceSize aligned = alignUp(block.head, alignment);
+			if (aligned + size > block.size)
+				return false;
+			block.head = aligned + size;
+			offset = aligned;
+			return true;
+		}
+
+		/** @brief Returns the range to the free list and merges it with its neighbours */
+		static void freeRange(Block& block, VkDeviceSize offset, VkDeviceSize size)
+		{
+			auto next = block.freeRanges.lower_bound(offset);
+			if (next != block.freeRanges.end() && offset + size == next->first)
+			{
+				size += next->second;
+				next = block.freeRanges.erase(next);
+			}
+			if (next != block.freeRanges.begin())
+			{
+				auto previous = std::prev(next);
+				if (previous->first + previous->second == offset)
+				{
+					previous->second += size;
+					return;
+				}
+			}
+			block.freeRanges[offset] = size;
+		}
+
+	public:
+		MemoryAllocator() = default;
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		~MemoryAllocator()
+		{
+			destroy();
+		}
+
+		/**
+		* Prepares the pools of every memory type, blocks are only allocated with the first buffer
+		*
+		* @param device Logical device the memory is allocated from
+		* @param memoryProperties Memory types and heaps of the physical device
+		* @param limits Limits of the physical device, for the non coherent atom size
+		*/
+		void init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits)
+		{
+			this->device = device;
+			this->memoryProperties = memoryProperties;
+			nonCoherentAtomSize = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+			blockSizes.resize(memoryProperties.memoryTypeCount);
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			{
+				VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+				blockSizes[i] = std::min(DEFAULT_BLOCK_SIZE, alignUp(heapSize / 8, nonCoherentAtomSize));
+			}
+			pools.resize(memoryProperties.memoryTypeCount * POOL_COUNT);
+		}
+
+		/** @brief Frees all the blocks, every buffer placed in them has to be destroyed already */
+		void destroy()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& pool : pools)
+			{
+				for (auto& block : pool)
+					destroyBlock(block.get());
+				pool.clear();
+			}
+		}
+
+		/**
+		* Places memory of the given requirements into a block of the pool
+		*
+		* @param memReqs Requirements of the resource
+		* @param memoryType Memory type the resource is allocated from (one of memReqs.memoryTypeBits)
+		* @param pool Pool to use, allocations larger than half a block always get memory of their own
+		* @param allocation Filled with the memory and offset to bind the resource to
+		*
+		* @return VK_SUCCESS or the error of vkAllocateMemory
+		*/
+		VkResult allocate(const VkMemoryRequirements& memReqs, uint32_t memoryType, PoolType pool, Allocation& allocation)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			VkDeviceSize atom = atomSize(memoryType);
+			VkDeviceSize alignment = std::max(memReqs.alignment, atom);
+			VkDeviceSize size = alignUp(memReqs.size, atom);
+
+			allocation = Allocation{};
+			allocation.memoryType = memoryType;
+			allocation.size = size;
+
+			if (pool == POOL_DEDICATED || size > blockSizes[memoryType] / 2)
+			{
+				VkResult result = allocateMemory(size, memoryType, &allocation.memory);
+				if (result != VK_SUCCESS)
+					return result;
+				allocation.pool = POOL_DEDICATED;
+				dedicatedAllocations++;
+				dedicatedBytes += size;
+				return VK_SUCCESS;
+			}
+
+			auto tryBlock = [&](Block& block)
+			{
+				return pool == POOL_LINEAR ? allocateLinear(block, size, alignment, allocation.offset) : allocateFreeList(block, size, alignment, allocation.offset);
+			};
+
+			Block* target = nullptr;
+			for (auto& block : pools[memoryType * POOL_COUNT + pool])
+			{
+				if (tryBlock(*block))
+				{
+					target = block.get();
+					break;
+				}
+			}
+			if (!target)
+			{
+				target = createBlock(memoryType, pool);
+				if (!target)
+					return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+				tryBlock(*target);
+			}
+
+			target->allocations++;
+			allocation.pool = pool;
+			allocation.block = target;
+			allocation.memory = target->memory;
+			allocation.mapped = target->mapped ? static_cast<char*>(target->mapped) + allocation.offset : nullptr;
+			return VK_SUCCESS;
+		}
+
+		/**
+		* Returns the memory of an allocation, empty blocks are freed unless they are the last one of their pool
+		*/
+		void free(Allocation& allocation)
+		{
+			if (allocation.memory == VK_NULL_HANDLE)
+				return;
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (allocation.pool == POOL_DEDICATED)
+			{
+				vkFreeMemory(device, allocation.memory, nullptr);
+				dedicatedAllocations--;
+				dedicatedBytes -= allocation.size;
+				allocation = Allocation{};
+				return;
+			}
+
+			Block* block = allocation.block;
+			if (allocation.pool == POOL_FREE_LIST)
+				freeRange(*block, allocation.offset, allocation.size);
+			if (--block->allocations == 0)
+			{
+				block->head = 0;
+				auto& pool = pools[allocation.memoryType * POOL_COUNT + allocation.pool];
+				if (pool.size() > 1)
+				{
+					destroyBlock(block);
+					pool.erase(std::find_if(pool.begin(), pool.end(), [block](const std::unique_ptr<Block>& candidate) { return candidate.get() == block; }));
+				}
+			}
+			allocation = Allocation{};
+		}
+
+		Stats stats() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			Stats stats;
+			stats.dedicatedAllocations = dedicatedAllocations;
+			stats.reservedBytes = dedicatedBytes;
+			stats.usedBytes = dedicatedBytes;
+			stats.deviceAllocations = deviceAllocations;
+			VkDeviceSize freeBytes = 0;
+			VkDeviceSize largestFreeBytes = 0;
+			for (size_t p = 0; p < pools.size(); p++)
+			{
+				for (auto& block : pools[p])
+				{
+					stats.blocks++;
+					stats.allocations += block->allocations;
+					stats.reservedBytes += block->size;
+					if (p % POOL_COUNT == POOL_LINEAR)
+					{
+						// Holes of a linear block are only reclaimed once the block is empty
+						stats.usedBytes += block->allocations ? block->head : 0;
+						continue;
+					}
+					VkDeviceSize blockFree = 0;
+					VkDeviceSize blockLargest = 0;
+					for (auto& range : block->freeRanges)
+					{
+						blockFree += range.second;
+						blockLargest = std::max(blockLargest, range.second);
+					}
+					stats.largestFreeRange = std::max(stats.largestFreeRange, blockLargest);
+					largestFreeBytes += blockLargest;
+					stats.freeRanges += static_cast<uint32_t>(block->freeRanges.size());
+					stats.usedBytes += block->size - blockFree;
+					freeBytes += blockFree;
+				}
+			}
+			if (freeBytes > 0)
+				stats.fragmentation = 1.0f - static_cast<float>(largestFreeBytes) / static_cast<float>(freeBytes);
+			return stats;
+		}
+	};
+}
@@ -12,6 +12,7 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <cstring>
 
 #include "vulkan/vulkan.h"
 
@@ -26,6 +27,7 @@
 
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
@@ -42,9 +44,69 @@ namespace vks
 		VERTEX_COMPONENT_TANGENT = 0x4,
 		VERTEX_COMPONENT_BITANGENT = 0x5,
 		VERTEX_COMPONENT_DUMMY_FLOAT = 0x6,
-		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7
+		VERTEX_COMPONENT_DUMMY_VEC4 = 0x7,
+		// Compact components, 4 bytes each
+		VERTEX_COMPONENT_NORMAL_OCT16 = 0x8,	// Octahedral encoded normal, 2 x 16 bit snorm
+		VERTEX_COMPONENT_UV_HALF = 0x9,			// 2 x 16 bit float
+		VERTEX_COMPONENT_COLOR_UNORM8 = 0xA		// 4 x 8 bit unorm, alpha is 1
 	} Component;
 
+	/** @brief Maps a unit vector onto the octahedron unfolded into [-1, 1]^2 */
+	inline glm::vec2 octEncode(glm::vec3 n)
+	{
+		float l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+		if (l1 == 0.0f)
+			return glm::vec2(0.0f);
+		n /= l1;
+		glm::vec2 p(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			p = glm::vec2(1.0f - fabs(n.y), 1.0f - fabs(n.x));
+			p.x *= n.x >= 0.0f ? 1.0f : -1.0f;
+			p.y *= n.y >= 0.0f ? 1.0f : -1.0f;
+		}
+		return p;
+	}
+
+	/** @brief Appends one component of a vertex to a vertex buffer in the format of the component */
+	inline void appendComponent(std::vector<uint8_t>& buffer, Component component, glm::vec3 value)
+	{
+		auto append = [&buffer](const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			buffer.insert(buffer.end(), bytes, bytes + size);
+		};
+		uint32_t packed;
+		switch (component)
+		{
+		case VERTEX_COMPONENT_UV:
+			append(&value, 2 * sizeof(float));
+			break;
+		case VERTEX_COMPONENT_DUMMY_FLOAT:
+			append(&value, sizeof(float));
+			break;
+		case VERTEX_COMPONENT_DUMMY_VEC4:
+		{
+			glm::vec4 v(value, 0.0f);
+			append(&v, 4 * sizeof(float));
+			break;
+		}
+		case VERTEX_COMPONENT_NORMAL_OCT16:
+			packed = glm::packSnorm2x16(octEncode(value));
+			append(&packed, sizeof(packed));
+			break;
+		case VERTEX_COMPONENT_UV_HALF:
+			packed = glm::packHalf2x16(glm::vec2(value));
+			append(&packed, sizeof(packed));
+			break;
+		case VERTEX_COMPONENT_COLOR_UNORM8:
+			packed = glm::packUnorm4x8(glm::vec4(value, 1.0f));
+			append(&packed, sizeof(packed));
+			break;
+		default:
+			append(&value, 3 * sizeof(float));
+		}
+	}
+
 	/** @brief Stores vertex layout components for model loading and Vulkan vertex input and atribute bindings  */
 	struct VertexLayout {
 	public:
@@ -56,29 +118,59 @@ namespace vks
 			this->components = std::move(components);
 		}
 
-		uint32_t stride()
+		static uint32_t componentSize(Component component)
 		{
-			uint32_t res = 0;
-			for (auto& component : components)
+			switch (component)
 			{
-				switch (component)
-				{
-				case VERTEX_COMPONENT_UV:
-					res += 2 * sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_FLOAT:
-					res += sizeof(float);
-					break;
-				case VERTEX_COMPONENT_DUMMY_VEC4:
-					res += 4 * sizeof(float);
-					break;
-				default:
-					// All components except the ones listed above are made up of 3 floats
-					res += 3 * sizeof(float);
-				}
+			case VERTEX_COMPONENT_UV:
+				return 2 * sizeof(float);
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+			case VERTEX_COMPONENT_UV_HALF:
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return 4;
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return 4 * sizeof(float);
+			default:
+				// All components except the ones listed above are made up of 3 floats
+				return 3 * sizeof(float);
+			}
+		}
+
+		static VkFormat componentFormat(Component component)
+		{
+			switch (component)
+			{
+			case VERTEX_COMPONENT_UV:
+				return VK_FORMAT_R32G32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_FLOAT:
+				return VK_FORMAT_R32_SFLOAT;
+			case VERTEX_COMPONENT_DUMMY_VEC4:
+				return VK_FORMAT_R32G32B32A32_SFLOAT;
+			case VERTEX_COMPONENT_NORMAL_OCT16:
+				return VK_FORMAT_R16G16_SNORM;
+			case VERTEX_COMPONENT_UV_HALF:
+				return VK_FORMAT_R16G16_SFLOAT;
+			case VERTEX_COMPONENT_COLOR_UNORM8:
+				return VK_FORMAT_R8G8B8A8_UNORM;
+			default:
+				return VK_FORMAT_R32G32B32_SFLOAT;
 			}
+		}
+
+		/** @brief Offset of the component with the given index inside a vertex */
+		uint32_t offset(size_t index)
+		{
+			uint32_t res = 0;
+			for (size_t i = 0; i < index; i++)
+				res += componentSize(components[i]);
 			return res;
 		}
+
+		uint32_t stride()
+		{
+			return offset(components.size());
+		}
 	};
 
 	/** @brief Used to parametrize model loading */
@@ -112,6 +204,8 @@ namespace vks
 		vks::Buffer indices;
 		uint32_t indexCount = 0;
 		uint32_t vertexCount = 0;
+		/** @brief 16 bit indices are used whenever all the vertices can be addressed with them */
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
 		/** @brief Stores vertex and index base and counts for each part of a model */
 		struct ModelPart {
@@ -135,28 +229,35 @@ namespace vks
 		void destroy()
 		{		
 			assert(device);
-			vkDestroyBuffer(device, vertices.buffer, nullptr);
-			vkFreeMemory(device, vertices.memory, nullptr);
+			vertices.destroy();
 			if (indices.buffer != VK_NULL_HANDLE)
 			{
-				vkDestroyBuffer(device, indices.buffer, nullptr);
-				vkFreeMemory(device, indices.memory, nullptr);
+				indices.destroy();
 			}
 		}
 
+		/** @brief Vertices and indices of a model already in the layout they are uploaded in */
+		struct Data
+		{
+			std::vector<uint8_t> vertices;
+			std::vector<uint8_t> indices;
+			uint32_t vertexCount = 0;
+			uint32_t indexCount = 0;
+			VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+			std::vector<ModelPart> parts;
+			Dimension dim;
+		};
+
 		/**
-		* Loads a 3D model from a file into Vulkan buffers
+		* Imports a 3D model from a file with ASSIMP and converts it into the given vertex layout
 		*
-		* @param device Pointer to the Vulkan device used to generated the vertex and index buffers on
 		* @param filename File to load (must be a model format supported by ASSIMP)
 		* @param layout Vertex layout components (position, normals, tangents, etc.)
 		* @param createInfo MeshCreateInfo structure for load time settings like scale, center, etc.
-		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
+		* @param data Receives the converted vertices, indices and parts
 		*/
-		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, VkQueue copyQueue)
+		static bool importFromFile(const std::string& filename, vks::VertexLayout layout, vks::ModelCreateInfo *createInfo, Data& data)
 		{
-			this->device = device->logicalDevice;
-
 			Assimp::Importer Importer;
 			const aiScene* pScene;
 
@@ -184,197 +285,222 @@ namespace vks
 			free(meshData);
 #else
 			pScene = Importer.ReadFile(filename.c_str(), defaultFlags);
-			if (!pScene) {
-				std::string error = Importer.GetErrorString();
-				vks::tools::exitFatal(error + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
-			}
 #endif
 
-			if (pScene)
+			if (!pScene)
 			{
-				parts.clear();
-				parts.resize(pScene->mNumMeshes);
+				printf("Error parsing '%s': '%s'\n", filename.c_str(), Importer.GetErrorString());
+#if defined(__ANDROID__)
+				LOGE("Error parsing '%s': '%s'", filename.c_str(), Importer.GetErrorString());
+#endif
+				return false;
+			}
 
-				glm::vec3 scale(1.0f);
-				glm::vec2 uvscale(1.0f);
-				glm::vec3 center(0.0f);
-				if (createInfo)
-				{
-					scale = createInfo->scale;
-					uvscale = createInfo->uvscale;
-					center = createInfo->center;
-				}
+			data = Data{};
+			data.parts.resize(pScene->mNumMeshes);
+
+			glm::vec3 scale(1.0f);
+			glm::vec2 uvscale(1.0f);
+			glm::vec3 center(0.0f);
+			if (createInfo)
+			{
+				scale = createInfo->scale;
+				uvscale = createInfo->uvscale;
+				center = createInfo->center;
+			}
 
-				std::vector<float> vertexBuffer;
-				std::vector<uint32_t> indexBuffer;
+			std::vector<uint8_t>& vertexBuffer = data.vertices;
+			std::vector<uint32_t> indexBuffer;
+			std::vector<ModelPart>& parts = data.parts;
+			Dimension& dim = data.dim;
+			uint32_t& vertexCount = data.vertexCount;
+			uint32_t& indexCount = data.indexCount;
 
-				vertexCount = 0;
-				indexCount = 0;
+			// Load meshes
+			for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+			{
+				const aiMesh* paiMesh = pScene->mMeshes[i];
 
-				// Load meshes
-				for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
-				{
-					const aiMesh* paiMesh = pScene->mMeshes[i];
+				parts[i] = {};
+				parts[i].vertexBase = vertexCount;
+				parts[i].indexBase = indexCount;
 
-					parts[i] = {};
-					parts[i].vertexBase = vertexCount;
-					parts[i].indexBase = indexCount;
+				vertexCount += pScene->mMeshes[i]->mNumVertices;
 
-					vertexCount += pScene->mMeshes[i]->mNumVertices;
+				aiColor3D pColor(0.f, 0.f, 0.f);
+				pScene->mMaterials[paiMesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, pColor);
 
-					aiColor3D pColor(0.f, 0.f, 0.f);
-					pScene->mMaterials[paiMesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, pColor);
+				const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
-					const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+				for (unsigned int j = 0; j < paiMesh->mNumVertices; j++)
+				{
+					const aiVector3D* pPos = &(paiMesh->mVertices[j]);
+					const aiVector3D* pNormal = &(paiMesh->mNormals[j]);
+					const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][j]) : &Zero3D;
+					const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[j]) : &Zero3D;
+					const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[j]) : &Zero3D;
 
-					for (unsigned int j = 0; j < paiMesh->mNumVertices; j++)
+					for (auto& component : layout.components)
 					{
-						const aiVector3D* pPos = &(paiMesh->mVertices[j]);
-						const aiVector3D* pNormal = &(paiMesh->mNormals[j]);
-						const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][j]) : &Zero3D;
-						const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[j]) : &Zero3D;
-						const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[j]) : &Zero3D;
-
-						for (auto& component : layout.components)
-						{
-							switch (component) {
-							case VERTEX_COMPONENT_POSITION:
-								vertexBuffer.push_back(pPos->x * scale.x + center.x);
-								vertexBuffer.push_back(-pPos->y * scale.y + center.y);
-								vertexBuffer.push_back(pPos->z * scale.z + center.z);
-								break;
-							case VERTEX_COMPONENT_NORMAL:
-								vertexBuffer.push_back(pNormal->x);
-								vertexBuffer.push_back(-pNormal->y);
-								vertexBuffer.push_back(pNormal->z);
-								break;
-							case VERTEX_COMPONENT_UV:
-								vertexBuffer.push_back(pTexCoord->x * uvscale.s);
-								vertexBuffer.push_back(pTexCoord->y * uvscale.t);
-								break;
-							case VERTEX_COMPONENT_COLOR:
-								vertexBuffer.push_back(pColor.r);
-								vertexBuffer.push_back(pColor.g);
-								vertexBuffer.push_back(pColor.b);
-								break;
-							case VERTEX_COMPONENT_TANGENT:
-								vertexBuffer.push_back(pTangent->x);
-								vertexBuffer.push_back(pTangent->y);
-								vertexBuffer.push_back(pTangent->z);
-								break;
-							case VERTEX_COMPONENT_BITANGENT:
-								vertexBuffer.push_back(pBiTangent->x);
-								vertexBuffer.push_back(pBiTangent->y);
-								vertexBuffer.push_back(pBiTangent->z);
-								break;
-							// Dummy components for padding
-							case VERTEX_COMPONENT_DUMMY_FLOAT:
-								vertexBuffer.push_back(0.0f);
-								break;
-							case VERTEX_COMPONENT_DUMMY_VEC4:
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
-								vertexBuffer.push_back(0.0f);
-								break;
-							};
-						}
-
-						dim.max.x = fmax(pPos->x, dim.max.x);
-						dim.max.y = fmax(pPos->y, dim.max.y);
-						dim.max.z = fmax(pPos->z, dim.max.z);
-
-						dim.min.x = fmin(pPos->x, dim.min.x);
-						dim.min.y = fmin(pPos->y, dim.min.y);
-						dim.min.z = fmin(pPos->z, dim.min.z);
+						glm::vec3 value(0.0f);
+						switch (component) {
+						case VERTEX_COMPONENT_POSITION:
+							value = glm::vec3(pPos->x * scale.x + center.x, -pPos->y * scale.y + center.y, pPos->z * scale.z + center.z);
+							break;
+						case VERTEX_COMPONENT_NORMAL:
+						case VERTEX_COMPONENT_NORMAL_OCT16:
+							value = glm::vec3(pNormal->x, -pNormal->y, pNormal->z);
+							break;
+						case VERTEX_COMPONENT_UV:
+						case VERTEX_COMPONENT_UV_HALF:
+							value = glm::vec3(pTexCoord->x * uvscale.s, pTexCoord->y * uvscale.t, 0.0f);
+							break;
+						case VERTEX_COMPONENT_COLOR:
+						case VERTEX_COMPONENT_COLOR_UNORM8:
+							value = glm::vec3(pColor.r, pColor.g, pColor.b);
+							break;
+						case VERTEX_COMPONENT_TANGENT:
+							value = glm::vec3(pTangent->x, pTangent->y, pTangent->z);
+							break;
+						case VERTEX_COMPONENT_BITANGENT:
+							value = glm::vec3(pBiTangent->x, pBiTangent->y, pBiTangent->z);
+							break;
+						// Dummy components for padding stay zero
+						default:
+							break;
+						};
+						appendComponent(vertexBuffer, component, value);
 					}
 
-					dim.size = dim.max - dim.min;
-
-					parts[i].vertexCount = paiMesh->mNumVertices;
+					dim.max.x = fmax(pPos->x, dim.max.x);
+					dim.max.y = fmax(pPos->y, dim.max.y);
+					dim.max.z = fmax(pPos->z, dim.max.z);
 
-					uint32_t indexBase = static_cast<uint32_t>(indexBuffer.size());
-					for (unsigned int j = 0; j < paiMesh->mNumFaces; j++)
-					{
-						const aiFace& Face = paiMesh->mFaces[j];
-						if (Face.mNumIndices != 3)
-							continue;
-						indexBuffer.push_back(indexBase + Face.mIndices[0]);
-						indexBuffer.push_back(indexBase + Face.mIndices[1]);
-						indexBuffer.push_back(indexBase + Face.mIndices[2]);
-						parts[i].indexCount += 3;
-						indexCount += 3;
-					}
+					dim.min.x = fmin(pPos->x, dim.min.x);
+					dim.min.y = fmin(pPos->y, dim.min.y);
+					dim.min.z = fmin(pPos->z, dim.min.z);
 				}
 
+				dim.size = dim.max - dim.min;
+
+				parts[i].vertexCount = paiMesh->mNumVertices;
 
-				uint32_t vBufferSize = static_cast<uint32_t>(vertexBuffer.size()) * sizeof(float);
-				uint32_t iBufferSize = static_cast<uint32_t>(indexBuffer.size()) * sizeof(uint32_t);
-
-				// Use staging buffer to move vertex and index buffer to device local memory
-				// Create staging buffers
-				vks::Buffer vertexStaging, indexStaging;
-
-				// Vertex buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&vertexStaging,
-					vBufferSize,
-					vertexBuffer.data()));
-
-				// Index buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					&indexStaging,
-					iBufferSize,
-					indexBuffer.data()));
-
-				// Create device local target buffers
-				// Vertex buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | createInfo->memoryPropertyFlags,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&vertices,
-					vBufferSize));
-
-				// Index buffer
-				VK_CHECK_RESULT(device->createBuffer(
-					VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | createInfo->memoryPropertyFlags,
-					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-					&indices,
-					iBufferSize));
-
-				// Copy from staging buffers
-				VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-				VkBufferCopy copyRegion{};
-
-				copyRegion.size = vertices.size;
-				vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-				copyRegion.size = indices.size;
-				vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
-
-				device->flushCommandBuffer(copyCmd, copyQueue);
-
-				// Destroy staging resources
-				vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-				vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
-
-				return true;
+				// Face indices are relative to the vertices of the part
+				uint32_t indexBase = parts[i].vertexBase;
+				for (unsigned int j = 0; j < paiMesh->mNumFaces; j++)
+				{
+					const aiFace& Face = paiMesh->mFaces[j];
+					if (Face.mNumIndices != 3)
+						continue;
+					indexBuffer.push_back(indexBase + Face.mIndices[0]);
+					indexBuffer.push_back(indexBase + Face.mIndices[1]);
+					indexBuffer.push_back(indexBase + Face.mIndices[2]);
+					parts[i].indexCount += 3;
+					indexCount += 3;
+				}
+			}
+
+			// Small meshes take half the index memory and bandwidth
+			if (vertexCount <= UINT16_MAX)
+			{
+				std::vector<uint16_t> shortIndexBuffer(indexBuffer.begin(), indexBuffer.end());
+				data.indices.resize(shortIndexBuffer.size() * sizeof(uint16_t));
+				memcpy(data.indices.data(), shortIndexBuffer.data(), data.indices.size());
+				data.indexType = VK_INDEX_TYPE_UINT16;
 			}
 			else
 			{
-				printf("Error parsing '%s': '%s'\n", filename.c_str(), Importer.GetErrorString());
-#if defined(__ANDROID__)
-				LOGE("Error parsing '%s': '%s'", filename.c_str(), Importer.GetErrorString());
+				data.indices.resize(indexBuffer.size() * sizeof(uint32_t));
+				memcpy(data.indices.data(), indexBuffer.data(), data.indices.size());
+				data.indexType = VK_INDEX_TYPE_UINT32;
+			}
+
+			return true;
+		}
+
+		/**
+		* Creates the device local buffers of the model and adds the copies of vertices and indices
+		* that are already in their final layout to a batch, the data has to stay valid until it is submitted
+		*
+		* The counts, index type, parts and dimensions of the model have to be set by the caller
+		*
+		* @param vertexData Vertices, vertexSize bytes of them
+		* @param indexData Indices, indexSize bytes of them
+		* @param createInfo MeshCreateInfo structure with the additional buffer usage flags, may be null
+		* @param device Pointer to the Vulkan device used to generated the vertex and index buffers on
+		* @param batch Batch the copies are recorded into
+		*/
+		void upload(const void* vertexData, VkDeviceSize vertexSize, const void* indexData, VkDeviceSize indexSize, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, vks::UploadBatch& batch)
+		{
+			this->device = device->logicalDevice;
+
+			VkBufferUsageFlags extraUsage = createInfo ? createInfo->memoryPropertyFlags : 0;
+
+			// Vertex buffer
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | extraUsage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&vertices,
+				vertexSize));
+
+			// Index buffer
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | extraUsage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&indices,
+				indexSize));
+
+			batch.addBuffer(vertexData, vertexSize, vertices.buffer);
+			batch.addBuffer(indexData, indexSize, indices.buffer);
+		}
+
+		/**
+		* Uploads vertices and indices that are already in their final layout into device local buffers
+		*
+		* The counts, index type, parts and dimensions of the model have to be set by the caller
+		*
+		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
+		*/
+		void upload(const void* vertexData, VkDeviceSize vertexSize, const void* indexData, VkDeviceSize indexSize, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, VkQueue copyQueue)
+		{
+			vks::UploadBatch batch(device);
+			upload(vertexData, vertexSize, indexData, indexSize, createInfo, device, batch);
+			batch.submit(copyQueue);
+		}
+
+		/** @brief Takes over the counts, parts and dimensions of converted data */
+		void setData(const Data& data)
+		{
+			vertexCount = data.vertexCount;
+			indexCount = data.indexCount;
+			indexType = data.indexType;
+			parts = data.parts;
+			dim = data.dim;
+		}
+
+		/**
+		* Loads a 3D model from a file into Vulkan buffers
+		*
+		* @param device Pointer to the Vulkan device used to generated the vertex and index buffers on
+		* @param filename File to load (must be a model format supported by ASSIMP)
+		* @param layout Vertex layout components (position, normals, tangents, etc.)
+		* @param createInfo MeshCreateInfo structure for load time settings like scale, center, etc.
+		* @param copyQueue Queue used for the memory staging copy commands (must support transfer)
+		*/
+		bool loadFromFile(const std::string& filename, vks::VertexLayout layout, vks::ModelCreateInfo *createInfo, vks::VulkanDevice *device, VkQueue copyQueue)
+		{
+			Data data;
+			if (!importFromFile(filename, layout, createInfo, data))
+			{
+#if !defined(__ANDROID__)
+				vks::tools::exitFatal("Could not load \"" + filename + "\"\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 #endif
 				return false;
 			}
+
+			setData(data);
+			upload(data.vertices.data(), data.vertices.size(), data.indices.data(), data.indices.size(), createInfo, device, copyQueue);
+			return true;
 		};
 
 		/**
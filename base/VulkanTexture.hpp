@@ -16,10 +16,12 @@
 #include "vulkan/vulkan.h"
 
 #include <gli/gli.hpp>
+#include <gli/sampler2d.hpp>
 
 #include "VulkanTools.h"
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanUploadBatch.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
@@ -27,6 +29,28 @@
 
 namespace vks
 {
+	/**
+	* Resamples the first mip level of an uncompressed image to another extent (bilinear) and regenerates the given number of mip levels,
+	* e.g. to bring images of different sizes into one texture array
+	*/
+	inline gli::texture2d resizeTexture(const gli::texture2d& source, gli::extent2d extent, size_t levels)
+	{
+		gli::texture2d target(source.format(), extent, levels);
+		gli::fsampler2D reader(source, gli::WRAP_CLAMP_TO_EDGE, gli::FILTER_LINEAR, gli::FILTER_LINEAR);
+		gli::fsampler2D writer(target, gli::WRAP_CLAMP_TO_EDGE, gli::FILTER_LINEAR, gli::FILTER_LINEAR);
+		for (int y = 0; y < extent.y; y++)
+		{
+			for (int x = 0; x < extent.x; x++)
+			{
+				glm::vec2 uv((x + 0.5f) / extent.x, (y + 0.5f) / extent.y);
+				writer.texel_write(gli::extent2d(x, y), 0, reader.texture_lod(uv, 0.0f));
+			}
+		}
+		if (levels > 1)
+			writer.generate_mipmaps(0, levels - 1, gli::FILTER_LINEAR);
+		return target;
+	}
+
 	/** @brief Vulkan texture base class */
 	class Texture {
 	public:
@@ -368,6 +392,113 @@ namespace vks
 			updateDescriptor();
 		}
 
+		/**
+		* Creates a 2D texture including all mip levels from an already decoded image and adds its upload to a batch
+		*
+		* @param tex2D Decoded image, it has to stay valid until the batch is submitted
+		* @param format Vulkan format of the image data
+		* @param device Vulkan device to create the texture on
+		* @param batch Batch the staging copy is recorded into
+		* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+		* @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		*
+		*/
+		void fromTexture(
+			const gli::texture2d& tex2D,
+			VkFormat format,
+			vks::VulkanDevice *device,
+			vks::UploadBatch& batch,
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
+			assert(!tex2D.empty());
+
+			this->device = device;
+			width = static_cast<uint32_t>(tex2D[0].extent().x);
+			height = static_cast<uint32_t>(tex2D[0].extent().y);
+			mipLevels = static_cast<uint32_t>(tex2D.levels());
+
+			// Setup buffer copy regions for each mip level, relative to the start of the image data
+			std::vector<VkBufferImageCopy> bufferCopyRegions;
+			VkDeviceSize offset = 0;
+
+			for (uint32_t i = 0; i < mipLevels; i++)
+			{
+				VkBufferImageCopy bufferCopyRegion = {};
+				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				bufferCopyRegion.imageSubresource.mipLevel = i;
+				bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+				bufferCopyRegion.imageSubresource.layerCount = 1;
+				bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(tex2D[i].extent().x);
+				bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(tex2D[i].extent().y);
+				bufferCopyRegion.imageExtent.depth = 1;
+				bufferCopyRegion.bufferOffset = offset;
+
+				bufferCopyRegions.push_back(bufferCopyRegion);
+
+				offset += tex2D[i].size();
+			}
+
+			// Create optimal tiled target image
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = format;
+			imageCreateInfo.mipLevels = mipLevels;
+			imageCreateInfo.arrayLayers = 1;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.extent = { width, height, 1 };
+			imageCreateInfo.usage = imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.baseMipLevel = 0;
+			subresourceRange.levelCount = mipLevels;
+			subresourceRange.layerCount = 1;
+
+			this->imageLayout = imageLayout;
+			batch.addImage(tex2D.data(), tex2D.size(), image, std::move(bufferCopyRegions), subresourceRange, imageLayout);
+
+			// Create a default sampler
+			VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+			samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.mipLodBias = 0.0f;
+			samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+			samplerCreateInfo.minLod = 0.0f;
+			samplerCreateInfo.maxLod = (float)mipLevels;
+			samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
+			samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
+			samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+
+			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCreateInfo.format = format;
+			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+			viewCreateInfo.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+
+			updateDescriptor();
+		}
+
 		/**
 		* Creates a 2D texture from a buffer
 		*
@@ -549,6 +680,116 @@ namespace vks
 	/** @brief 2D array texture */
 	class Texture2DArray : public Texture {
 	public:
+		/**
+		* Creates a 2D texture array including all mip levels from already decoded images and adds its upload to a batch
+		*
+		* @param layers Decoded images, one per layer, all of the same extent and mip level count. They have to stay valid until the batch is submitted
+		* @param format Vulkan format of the image data
+		* @param device Vulkan device to create the texture on
+		* @param batch Batch the staging copies are recorded into
+		* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+		* @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		*
+		*/
+		void fromTextures(
+			const std::vector<gli::texture2d>& layers,
+			VkFormat format,
+			vks::VulkanDevice *device,
+			vks::UploadBatch& batch,
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
+			assert(!layers.empty());
+
+			this->device = device;
+			width = static_cast<uint32_t>(layers[0].extent().x);
+			height = static_cast<uint32_t>(layers[0].extent().y);
+			layerCount = static_cast<uint32_t>(layers.size());
+			mipLevels = static_cast<uint32_t>(layers[0].levels());
+
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = format;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.extent = { width, height, 1 };
+			imageCreateInfo.usage = imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			imageCreateInfo.arrayLayers = layerCount;
+			imageCreateInfo.mipLevels = mipLevels;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+
+			// Every layer is copied from its own image, offsets are relative to its data
+			for (uint32_t layer = 0; layer < layerCount; layer++)
+			{
+				const gli::texture2d& tex2D = layers[layer];
+				assert(tex2D.extent() == layers[0].extent() && tex2D.levels() == layers[0].levels());
+
+				std::vector<VkBufferImageCopy> bufferCopyRegions;
+				VkDeviceSize offset = 0;
+				for (uint32_t level = 0; level < mipLevels; level++)
+				{
+					VkBufferImageCopy bufferCopyRegion = {};
+					bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					bufferCopyRegion.imageSubresource.mipLevel = level;
+					bufferCopyRegion.imageSubresource.baseArrayLayer = layer;
+					bufferCopyRegion.imageSubresource.layerCount = 1;
+					bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(tex2D[level].extent().x);
+					bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(tex2D[level].extent().y);
+					bufferCopyRegion.imageExtent.depth = 1;
+					bufferCopyRegion.bufferOffset = offset;
+					bufferCopyRegions.push_back(bufferCopyRegion);
+					offset += tex2D[level].size();
+				}
+
+				VkImageSubresourceRange subresourceRange = {};
+				subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				subresourceRange.baseMipLevel = 0;
+				subresourceRange.levelCount = mipLevels;
+				subresourceRange.baseArrayLayer = layer;
+				subresourceRange.layerCount = 1;
+
+				batch.addImage(tex2D.data(), tex2D.size(), image, std::move(bufferCopyRegions), subresourceRange, imageLayout);
+			}
+			this->imageLayout = imageLayout;
+
+			VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+			samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCreateInfo.mipLodBias = 0.0f;
+			samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+			samplerCreateInfo.minLod = 0.0f;
+			samplerCreateInfo.maxLod = (float)mipLevels;
+			samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
+			samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
+			samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+
+			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCreateInfo.format = format;
+			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layerCount };
+			viewCreateInfo.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+
+			updateDescriptor();
+		}
+
 		/**
 		* Load a 2D texture array including all mip levels
 		*
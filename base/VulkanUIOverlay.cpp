@@ -288,7 +288,7 @@ namespace vks
 	}
 
 	/** Update vertex and index buffer containing the imGui elements when required */
-	bool UIOverlay::update()
+	bool UIOverlay::update(uint32_t frame)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		bool updateCmdBuffers = false;
@@ -304,6 +304,14 @@ namespace vks
 			return false;
 		}
 
+		if (frame >= frames.size()) {
+			frames.resize(frame + 1);
+		}
+		vks::Buffer& vertexBuffer = frames[frame].vertexBuffer;
+		vks::Buffer& indexBuffer = frames[frame].indexBuffer;
+		int32_t& vertexCount = frames[frame].vertexCount;
+		int32_t& indexCount = frames[frame].indexCount;
+
 		// Vertex buffer
 		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
 			vertexBuffer.unmap();
@@ -345,7 +353,7 @@ namespace vks
 		return updateCmdBuffers;
 	}
 
-	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	void UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t frame)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		int32_t vertexOffset = 0;
@@ -355,6 +363,13 @@ namespace vks
 			return;
 		}
 
+		// Nothing was uploaded for this frame yet
+		if ((frame >= frames.size()) || (frames[frame].vertexBuffer.buffer == VK_NULL_HANDLE)) {
+			return;
+		}
+		vks::Buffer& vertexBuffer = frames[frame].vertexBuffer;
+		vks::Buffer& indexBuffer = frames[frame].indexBuffer;
+
 		ImGuiIO& io = ImGui::GetIO();
 
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
@@ -396,8 +411,10 @@ namespace vks
 	void UIOverlay::freeResources()
 	{
 		ImGui::DestroyContext();
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		for (auto& frame : frames) {
+			frame.vertexBuffer.destroy();
+			frame.indexBuffer.destroy();
+		}
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
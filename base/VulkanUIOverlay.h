@@ -39,10 +39,15 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		uint32_t subpass = 0;
 
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount = 0;
-		int32_t indexCount = 0;
+		// Geometry buffers are kept per swap chain image, so that the overlay can be
+		// updated while previous frames are still being rendered
+		struct FrameBuffers {
+			vks::Buffer vertexBuffer;
+			vks::Buffer indexBuffer;
+			int32_t vertexCount = 0;
+			int32_t indexCount = 0;
+		};
+		std::vector<FrameBuffers> frames;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -72,8 +77,8 @@ namespace vks
 		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass);
 		void prepareResources();
 
-		bool update();
-		void draw(const VkCommandBuffer commandBuffer);
+		bool update(uint32_t frame = 0);
+		void draw(const VkCommandBuffer commandBuffer, uint32_t frame = 0);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
@@ -0,0 +1,260 @@
+/*
+* Batched staging uploads
+*
+* Collects the data of many buffers and images, copies all of it into one
+* host visible staging buffer and records every copy into one command
+* buffer, so that any number of assets costs a single submit and a single
+* fence wait instead of one of each per asset.
+*
+* This code is licensed under the MIT license(MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	class UploadBatch
+	{
+		struct BufferCopy
+		{
+			const void* data;
+			VkDeviceSize size;
+			VkBuffer buffer;
+			VkDeviceSize bufferOffset;
+			VkDeviceSize stagingOffset;
+		};
+
+		struct ImageCopy
+		{
+			const void* data;
+			VkDeviceSize size;
+			VkImage image;
+			std::vector<VkBufferImageCopy> regions;
+			VkImageSubresourceRange subresourceRange;
+			VkImageLayout finalLayout;
+			VkDeviceSize stagingOffset;
+		};
+
+		vks::VulkanDevice* device;
+		std::vector<BufferCopy> bufferCopies;
+		std::vector<ImageCopy> imageCopies;
+		VkDeviceSize stagingSize = 0;
+
+		VkDeviceSize reserve(VkDeviceSize size)
+		{
+			// Offsets of buffer to image copies must be a multiple of the texel size and of 4
+			VkDeviceSize offset = (stagingSize + 15) & ~VkDeviceSize(15);
+			stagingSize = offset + size;
+			return offset;
+		}
+
+	public:
+		explicit UploadBatch(vks::VulkanDevice* device) : device(device) {}
+
+		/**
+		* Adds a copy of data into a buffer at bufferOffset, data has to stay valid until submit() returns
+		*/
+		void addBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize bufferOffset = 0)
+		{
+			if (size == 0)
+				return;
+			bufferCopies.push_back({ data, size, buffer, bufferOffset, reserve(size) });
+		}
+
+		/**
+		* Adds a copy of data into all the given regions of an image, data has to stay valid until submit() returns
+		*
+		* @param regions Copy regions with their buffer offsets relative to data
+		* @param subresourceRange Subresources the regions cover, they are moved from undefined to finalLayout
+		*/
+		void addImage(const void* data, VkDeviceSize size, VkImage image, std::vector<VkBufferImageCopy> regions, VkImageSubresourceRange subresourceRange, VkImageLayout finalLayout)
+		{
+			imageCopies.push_back({ data, size, image, std::move(regions), subresourceRange, finalLayout, reserve(size) });
+		}
+
+		/** @brief Bytes that go through the staging buffer */
+		VkDeviceSize size() const
+		{
+			return stagingSize;
+		}
+
+		size_t count() const
+		{
+			return bufferCopies.size() + imageCopies.size();
+		}
+
+		/**
+		* Ownership transfer of everything in a batch from the queue family that copies it to the one that uses it
+		*/
+		struct OwnershipTransfer
+		{
+			uint32_t srcQueueFamily;
+			uint32_t dstQueueFamily;
+			/** @brief Filled by record(), to be recorded on a queue of dstQueueFamily once the copies have finished */
+			std::vector<VkBufferMemoryBarrier> bufferAcquires;
+			std::vector<VkImageMemoryBarrier> imageAcquires;
+		};
+
+		/**
+		* Creates the staging buffer and copies all the data into it, the data may be released afterwards
+		*
+		* @param staging Buffer to create, it has to live until the copies recorded from it have finished
+		*/
+		void stage(vks::Buffer& staging)
+		{
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&staging,
+				stagingSize));
+
+			VK_CHECK_RESULT(staging.map());
+			uint8_t* mapped = static_cast<uint8_t*>(staging.mapped);
+			for (auto& copy : bufferCopies)
+				memcpy(mapped + copy.stagingOffset, copy.data, copy.size);
+			for (auto& copy : imageCopies)
+				memcpy(mapped + copy.stagingOffset, copy.data, copy.size);
+			staging.unmap();
+		}
+
+		/**
+		* Records every copy from the staging buffer. With an ownership transfer the buffers and images are
+		* released to its dstQueueFamily, images change to their final layout with the release
+		*
+		* @param copyCmd Command buffer of a queue of the source family
+		* @param staging Buffer filled by stage()
+		* @param transfer (Optional) Ownership transfer, receives the matching acquire barriers
+		*/
+		void record(VkCommandBuffer copyCmd, const vks::Buffer& staging, OwnershipTransfer* transfer = nullptr)
+		{
+			if (transfer && transfer->srcQueueFamily == transfer->dstQueueFamily)
+				transfer = nullptr;
+
+			std::vector<VkBufferMemoryBarrier> bufferReleases;
+			for (auto& copy : bufferCopies)
+			{
+				VkBufferCopy region{};
+				region.srcOffset = copy.stagingOffset;
+				region.dstOffset = copy.bufferOffset;
+				region.size = copy.size;
+				vkCmdCopyBuffer(copyCmd, staging.buffer, copy.buffer, 1, &region);
+
+				if (transfer)
+				{
+					VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+					barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					barrier.dstAccessMask = 0;
+					barrier.srcQueueFamilyIndex = transfer->srcQueueFamily;
+					barrier.dstQueueFamilyIndex = transfer->dstQueueFamily;
+					barrier.buffer = copy.buffer;
+					barrier.offset = copy.bufferOffset;
+					barrier.size = copy.size;
+					bufferReleases.push_back(barrier);
+
+					barrier.srcAccessMask = 0;
+					barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+					transfer->bufferAcquires.push_back(barrier);
+				}
+			}
+
+			std::vector<VkImageMemoryBarrier> imageReleases;
+			for (auto& copy : imageCopies)
+			{
+				std::vector<VkBufferImageCopy> regions = copy.regions;
+				for (auto& region : regions)
+					region.bufferOffset += copy.stagingOffset;
+
+				vks::tools::setImageLayout(
+					copyCmd,
+					copy.image,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					copy.subresourceRange);
+
+				vkCmdCopyBufferToImage(
+					copyCmd,
+					staging.buffer,
+					copy.image,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					static_cast<uint32_t>(regions.size()),
+					regions.data());
+
+				if (!transfer)
+				{
+					vks::tools::setImageLayout(
+						copyCmd,
+						copy.image,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						copy.finalLayout,
+						copy.subresourceRange);
+					continue;
+				}
+
+				// Release and acquire carry the same layout transition, it is executed once
+				VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = copy.finalLayout;
+				barrier.srcQueueFamilyIndex = transfer->srcQueueFamily;
+				barrier.dstQueueFamilyIndex = transfer->dstQueueFamily;
+				barrier.image = copy.image;
+				barrier.subresourceRange = copy.subresourceRange;
+				imageReleases.push_back(barrier);
+
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				transfer->imageAcquires.push_back(barrier);
+			}
+
+			if (!bufferReleases.empty() || !imageReleases.empty())
+			{
+				vkCmdPipelineBarrier(
+					copyCmd,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					0,
+					0, nullptr,
+					static_cast<uint32_t>(bufferReleases.size()), bufferReleases.data(),
+					static_cast<uint32_t>(imageReleases.size()), imageReleases.data());
+			}
+		}
+
+		/** @brief Forgets all the copies, the batch can be filled again */
+		void clear()
+		{
+			bufferCopies.clear();
+			imageCopies.clear();
+			stagingSize = 0;
+		}
+
+		/**
+		* Stages all the data, records every copy into one command buffer and waits for it once
+		*
+		* @param copyQueue Queue used for the copy commands (must support transfer)
+		*/
+		void submit(VkQueue copyQueue)
+		{
+			if (count() == 0)
+				return;
+
+			vks::Buffer staging;
+			stage(staging);
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			record(copyCmd, staging);
+			device->flushCommandBuffer(copyCmd, copyQueue);
+
+			staging.destroy();
+			clear();
+		}
+	};
+}
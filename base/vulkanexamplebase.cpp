@@ -10,6 +10,7 @@
 
 #include "vulkanexamplebase.h"
 #include <unistd.h>
+#include <fstream>
 #include "../Maze/MazeUI.h"
 std::vector<const char*> VulkanExampleBase::args;
 
@@ -196,9 +197,62 @@ void VulkanExampleBase::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueu
 
 void VulkanExampleBase::createPipelineCache()
 {
+	// The data is only used if its header names this device and driver, otherwise the cache starts empty
+	std::vector<char> data;
+	std::ifstream file(pipelineCacheFile, std::ios::binary | std::ios::ate);
+	if (file.is_open())
+	{
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		if (!file)
+			data.clear();
+	}
+
+	if (data.size() >= 16 + VK_UUID_SIZE)
+	{
+		uint32_t header[4];
+		memcpy(header, data.data(), sizeof(header));
+		bool valid = header[0] >= 16 + VK_UUID_SIZE &&
+			header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header[2] == deviceProperties.vendorID &&
+			header[3] == deviceProperties.deviceID &&
+			memcmp(data.data() + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		if (!valid)
+		{
+			std::cout << "Pipeline cache '" << pipelineCacheFile << "' was made by another device or driver, ignoring it" << std::endl;
+			data.clear();
+		}
+	}
+	else
+	{
+		data.clear();
+	}
+
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = data.size();
+	pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
 	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	pipelineCacheLoadedSize = data.size();
+}
+
+void VulkanExampleBase::savePipelineCache()
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return;
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS)
+		return;
+
+	std::ofstream file(pipelineCacheFile, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write pipeline cache '" << pipelineCacheFile << "'" << std::endl;
+		return;
+	}
+	file.write(data.data(), size);
 }
 
 void VulkanExampleBase::prepare()
@@ -235,14 +289,23 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 	VkPipelineShaderStageCreateInfo shaderStage = {};
 	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	shaderStage.stage = stage;
+	shaderStage.pName = "main"; // todo : make param
+
+	auto cached = shaderModuleCache.find(fileName);
+	if (cached != shaderModuleCache.end())
+	{
+		shaderStage.module = cached->second;
+		return shaderStage;
+	}
+
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	shaderStage.module = vks::tools::loadShader(androidApp->activity->assetManager, fileName.c_str(), device);
 #else
 	shaderStage.module = vks::tools::loadShader(fileName.c_str(), device);
 #endif
-	shaderStage.pName = "main"; // todo : make param
 	assert(shaderStage.module != VK_NULL_HANDLE);
 	shaderModules.push_back(shaderStage.module);
+	shaderModuleCache[fileName] = shaderStage.module;
 	return shaderStage;
 }
 
@@ -388,13 +451,10 @@ void VulkanExampleBase::updateOverlay()
 	io.MouseDown[1] = mouseButtons.right;
 
 
-	bool man_upd = MazeUI::manager.update(width, height);
-
+	MazeUI::manager.update(width, height);
 
-	if (UIOverlay.update() || UIOverlay.updated || man_upd) {
-		buildCommandBuffers();
-		UIOverlay.updated = false;
-	}
+	// Overlay buffers are uploaded and recorded by the derived class with every frame
+	UIOverlay.updated = false;
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	if (mouseButtons.left) {
@@ -403,7 +463,7 @@ void VulkanExampleBase::updateOverlay()
 #endif
 }
 
-void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
+void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer, uint32_t frame)
 {
 	if (settings.overlay) {
 		const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -411,26 +471,44 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		UIOverlay.draw(commandBuffer);
+		UIOverlay.draw(commandBuffer, frame);
 	}
 }
 
 void VulkanExampleBase::prepareFrame()
 {
+	// Wait until the GPU has finished the frame that used the same synchronization objects
+	VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentFrame], VK_TRUE, UINT64_MAX));
+
 	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete[currentFrame], &currentBuffer);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		windowResize();
+		// Nothing was acquired, so the semaphore would never be signaled
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			VK_CHECK_RESULT(swapChain.acquireNextImage(semaphores.presentComplete[currentFrame], &currentBuffer));
+		}
 	}
 	else {
 		VK_CHECK_RESULT(result);
 	}
+
+	// The image may still be rendered by another frame in flight
+	if (imageFences[currentBuffer] != VK_NULL_HANDLE) {
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &imageFences[currentBuffer], VK_TRUE, UINT64_MAX));
+	}
+	imageFences[currentBuffer] = waitFences[currentFrame];
+
+	submitInfo.pWaitSemaphores = &semaphores.presentComplete[currentFrame];
+	submitInfo.pSignalSemaphores = &semaphores.renderComplete[currentFrame];
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete[currentFrame]);
+	// The queue is not waited for, the next frame is recorded while this one renders
+	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			// Swap chain is no longer compatible with the surface and needs to be recreated
@@ -440,7 +518,6 @@ void VulkanExampleBase::submitFrame()
 			VK_CHECK_RESULT(result);
 		}
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
 
 VulkanExampleBase::VulkanExampleBase(bool enableValidation)
@@ -575,12 +652,17 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
 
+	savePipelineCache();
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 
-	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
-	vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
+	for (auto& semaphore : semaphores.presentComplete) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	for (auto& semaphore : semaphores.renderComplete) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
 	for (auto& fence : waitFences) {
 		vkDestroyFence(device, fence, nullptr);
 	}
@@ -729,7 +811,8 @@ bool VulkanExampleBase::initVulkan()
 	// This is handled by a separate class that gets a logical device representation
 	// and encapsulates functions related to a device
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain);
+	// A transfer queue of its own is requested for uploads that shouldn't block the graphics queue
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, true, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 	if (res != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(res), res);
 		return false;
@@ -738,6 +821,8 @@ bool VulkanExampleBase::initVulkan()
 
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
+	// The same queue if the device has no transfer queue family apart from the graphics one
+	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.transfer, 0, &transferQueue);
 
 	// Find a suitable depth format
 	VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
@@ -745,24 +830,13 @@ bool VulkanExampleBase::initVulkan()
 
 	swapChain.connect(instance, physicalDevice, device);
 
-	// Create synchronization objects
-	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-	// Create a semaphore used to synchronize image presentation
-	// Ensures that the image is displayed before we start submitting new commands to the queu
-	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.presentComplete));
-	// Create a semaphore used to synchronize command submission
-	// Ensures that the image is not presented until all commands have been sumbitted and executed
-	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.renderComplete));
-
 	// Set up submit info structure
-	// Semaphores will stay the same during application lifetime
+	// Semaphores of the current frame in flight are set by prepareFrame
 	// Command buffer submission info is set by each example
 	submitInfo = vks::initializers::submitInfo();
 	submitInfo.pWaitDstStageMask = &submitPipelineStages;
 	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &semaphores.presentComplete;
 	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Get Android device name and manufacturer (to display along GPU name)
@@ -1846,12 +1920,27 @@ void VulkanExampleBase::buildCommandBuffers() {}
 
 void VulkanExampleBase::createSynchronizationPrimitives()
 {
-	// Wait fences to sync command buffer access
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	// Semaphores used to synchronize image presentation
+	// Ensure that the image is displayed before we start submitting new commands to the queue
+	semaphores.presentComplete.resize(MAX_FRAMES_IN_FLIGHT);
+	for (auto& semaphore : semaphores.presentComplete) {
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+	}
+	// Semaphores used to synchronize command submission
+	// Ensure that the image is not presented until all commands have been sumbitted and executed
+	semaphores.renderComplete.resize(MAX_FRAMES_IN_FLIGHT);
+	for (auto& semaphore : semaphores.renderComplete) {
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+	}
+
+	// Wait fences to sync the frames in flight, created signaled so the first frames don't wait
 	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-	waitFences.resize(drawCmdBuffers.size());
+	waitFences.resize(MAX_FRAMES_IN_FLIGHT);
 	for (auto& fence : waitFences) {
 		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
 	}
+	imageFences.assign(swapChain.imageCount, VK_NULL_HANDLE);
 }
 
 void VulkanExampleBase::createCommandPool()
@@ -2045,6 +2134,9 @@ void VulkanExampleBase::windowResize()
 	createCommandBuffers();
 	buildCommandBuffers();
 
+	// The device is idle, so no image is in use anymore and their number may have changed
+	imageFences.assign(swapChain.imageCount, VK_NULL_HANDLE);
+
 	vkDeviceWaitIdle(device);
 
 	if ((width > 0.0f) && (height > 0.0f)) {
@@ -38,6 +38,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <string>
+#include <map>
 #include <array>
 #include <numeric>
 
@@ -95,6 +96,8 @@ protected:
 	VkDevice device;
 	// Handle to the device graphics queue that command buffers are submitted to
 	VkQueue queue;
+	// Queue of queueFamilyIndices.transfer for asynchronous uploads, it may be the graphics queue
+	VkQueue transferQueue;
 	// Depth buffer format (selected during Vulkan initialization)
 	VkFormat depthFormat;
 	// Command buffer pool
@@ -115,18 +118,31 @@ protected:
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	// List of shader modules created (stored for cleanup)
 	std::vector<VkShaderModule> shaderModules;
+	// Shader modules by file name, every file is loaded once
+	std::map<std::string, VkShaderModule> shaderModuleCache;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache;
+	// File the pipeline cache is read from at startup and written to on exit
+	std::string pipelineCacheFile = "pipelinecache.bin";
+	// Size of the pipeline cache data read from pipelineCacheFile, 0 if the cache started empty
+	size_t pipelineCacheLoadedSize = 0;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
-	// Synchronization semaphores
+	// Number of frames the CPU may record and submit ahead of the GPU
+	static const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+	// Frame in flight currently being prepared
+	uint32_t currentFrame = 0;
+	// Synchronization semaphores, one per frame in flight
 	struct {
 		// Swap chain image presentation
-		VkSemaphore presentComplete;
+		std::vector<VkSemaphore> presentComplete;
 		// Command buffer submission and execution
-		VkSemaphore renderComplete;
+		std::vector<VkSemaphore> renderComplete;
 	} semaphores;
+	// Signaled when the submission of a frame in flight has finished
 	std::vector<VkFence> waitFences;
+	// Fence of the frame that used the swap chain image last (VK_NULL_HANDLE if none)
+	std::vector<VkFence> imageFences;
 
 	UIFunc user_input;
 public: 
@@ -382,8 +398,10 @@ public:
 	// Note : Waits for the queue to become idle
 	void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free);
 
-	// Create a cache pool for rendering pipelines
+	// Create a cache pool for rendering pipelines, seeded from pipelineCacheFile if it was made by this device
 	void createPipelineCache();
+	// Write the pipeline cache to pipelineCacheFile
+	void savePipelineCache();
 
 	// Prepare commonly used Vulkan functions
 	virtual void prepare();
@@ -400,11 +418,12 @@ public:
 	void renderFrame();
 
 	void updateOverlay();
-	void drawUI(const VkCommandBuffer commandBuffer);
+	void drawUI(const VkCommandBuffer commandBuffer, uint32_t frame = 0);
 
 	// Prepare the frame for workload submission
 	// - Acquires the next image from the swap chain 
 	// - Sets the default wait and signal semaphores
+	// - Waits until the resources of the acquired image are no longer used by the GPU
 	void prepareFrame();
 
 	// Submit the frames' workload 
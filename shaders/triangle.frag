@@ -1,7 +1,8 @@
 #version 430
 #define TEXTURE_SAMPLER(a) samplerColor ## a
 
-#define TEXTURE(N) layout (binding = N) uniform sampler2D TEXTURE_SAMPLER(N)
+// All model textures are layers of one array, inUV.z selects the layer
+#define TEXTURE(N) layout (binding = N) uniform sampler2DArray TEXTURE_SAMPLER(N)
 
 TEXTURE(1);
 
@@ -15,7 +16,7 @@ layout (location = 5) in vec3 inColor;
 
 layout (location = 0) out vec4 outFragColor;
 
-sampler2D getTextureSampler(int id){
+sampler2DArray getTextureSampler(int id){
 	switch(id){
 		case 1: return TEXTURE_SAMPLER(1);
 		default: return TEXTURE_SAMPLER(1);
@@ -28,7 +29,7 @@ void main()
 		outFragColor = vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	else{
 	  float len_v_trace = length(inViewTrace);
-	  vec4 color = texture(samplerColor1, vec2(inUV.x, inUV.y), 1.0f);
+	  vec4 color = texture(samplerColor1, inUV, 1.0f);
 	  
 	  vec3 norm_trace = normalize(inTrace);
 	  vec3 norm_view_trace = normalize(inViewTrace);
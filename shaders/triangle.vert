@@ -6,17 +6,25 @@ layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
 layout (location = 3) in vec3 inColor;
 
+// Normals come octahedral encoded in xy with the compact vertex layout
+layout (constant_id = 0) const bool OCT_NORMALS = false;
+
 // Instanced attributes
 layout (location = 4) in vec3 instancePos;
-layout (location = 5) in vec3 instanceRot;
+layout (location = 5) in vec4 instanceRot;
 layout (location = 6) in float instanceScale;
+layout (location = 7) in vec3 instanceTo;
+layout (location = 8) in vec2 instanceMotion; // start time, duration
+layout (location = 9) in vec3 instanceSpin;   // angular velocity, radians per second
+layout (location = 10) in uint instanceLayer; // texture array layer of the model
 
 layout (binding = 0) uniform UBO
 {
 	mat4 projection;
 	vec4 viewPos;
 	vec4 lightPos;
-
+	vec4 frustumPlanes[6];
+	vec4 time;
 } ubo;
 
 layout (location = 0) out vec3 outUV;
@@ -33,44 +41,49 @@ out gl_PerVertex
 
 //The light source is attached to camera
 
-void main() 
+// Rotates v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
 {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
-	outUV = vec3(inUV, 0.0f);
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
 
+// Quaternion product a * b, both as (x, y, z, w)
+vec4 multiply(vec4 a, vec4 b)
+{
+	return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz), a.w * b.w - dot(a.xyz, b.xyz));
+}
 
-	mat3 mx, my, mz;
-	
-	// rotate around x
-	float s = sin(instanceRot.x);
-	float c = cos(instanceRot.x);
+void main() 
+{
 
-	mx[0] = vec3(c, s, 0.0);
-	mx[1] = vec3(-s, c, 0.0);
-	mx[2] = vec3(0.0, 0.0, 1.0);
-	
-	// rotate around y
-	s = sin(instanceRot.y);
-	c = cos(instanceRot.y);
+	outUV = vec3(inUV, float(instanceLayer));
 
-	my[0] = vec3(c, 0.0, s);
-	my[1] = vec3(0.0, 1.0, 0.0);
-	my[2] = vec3(-s, 0.0, c);
-	
-	// rot around z
-	s = sin(instanceRot.z);
-	c = cos(instanceRot.z);	
-	
-	mz[0] = vec3(1.0, 0.0, 0.0);
-	mz[1] = vec3(0.0, c, s);
-	mz[2] = vec3(0.0, -s, c);
-	
-	mat3 rotMat = mz * my * mx;
 
-	vec4 locPos = vec4(inPos.xyz * rotMat, 1.0);
-	vec4 pos = vec4((locPos.xyz * instanceScale * 5.0f) + instancePos, 1.0);
+	// Motion since the start time, the same as TransformSystem computes on the CPU
+	float elapsed = ubo.time.x - instanceMotion.x;
+	float progress = instanceMotion.y > 0.0 ? clamp(elapsed / instanceMotion.y, 0.0, 1.0) : 1.0;
+	vec3 position = mix(instancePos, instanceTo, progress);
 
+	// Unit quaternion (x, y, z, w), renormalized since it may come packed in half floats
+	vec4 q = normalize(instanceRot);
+	float rate = length(instanceSpin);
+	if (rate > 0.0)
+	{
+		// Wrapped to a full period, sin and cos are only precise for small arguments
+		float halfAngle = mod(0.5 * rate * elapsed, 6.2831853);
+		q = normalize(multiply(vec4(instanceSpin / rate * sin(halfAngle), cos(halfAngle)), q));
+	}
 
+	vec3 locPos = rotate(q, inPos.xyz);
+	vec4 pos = vec4((locPos * instanceScale * 5.0f) + position, 1.0);
 
 	gl_Position = ubo.projection * pos;
 
@@ -79,7 +92,8 @@ void main()
 //	vec3 normal = normalize(inNormal);
 
 
-	outNormal = normalize(inNormal.xyz * rotMat);
+	vec3 normal = OCT_NORMALS ? octDecode(inNormal.xy) : inNormal.xyz;
+	outNormal = normalize(rotate(q, normal));
 	outTrace = trace;
 	outViewTrace = ubo.viewPos.xyz - pos.xyz;
 	outLodBias = length(outViewTrace) / 100.0;